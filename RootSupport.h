@@ -1,12 +1,24 @@
 #ifndef ROOTSUPPORT_H
 #define ROOTSUPPORT_H
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <tuple>
 #include <type_traits>
 #include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -14,28 +26,46 @@
 #include "TAttLine.h"
 #include "TAttMarker.h"
 #include "TAxis.h"
+#include "TBox.h"
 #include "TCanvas.h"
+#include "TClass.h"
+#include "TClassTable.h"
 #include "TCollection.h"
 #include "TColor.h"
 #include "TDirectory.h"
 #include "TError.h"
 #include "TFile.h"
 #include "TGraph.h"
+#include "TGraphAsymmErrors.h"
 #include "TGraphErrors.h"
 #include "TH1.h"
 #include "THStack.h"
+#include "TInterpreter.h"
 #include "TKey.h"
+#include "TLatex.h"
+#include "TLegend.h"
 #include "TLine.h"
 #include "TList.h"
 #include "TMath.h"
 #include "TMultiGraph.h"
 #include "TObject.h"
 #include "TPaveStats.h"
+#include "TROOT.h"
+#include "TStyle.h"
 #include "TSystem.h"
+#include "TTree.h"
 #include "TVirtualFFT.h"
 
+#include "libs/RootColumnar.h"
+#include "libs/RootCut.h"
+#include "libs/RootDetach.h"
+#include "libs/RootFill.h"
+#include "libs/RootFit.h"
+#include "libs/RootParallel.h"
 #include "libs/RootStyle.h"
 #include "libs/RootTree.h"
+#include "libs/RootTreeIndex.h"
+#include "libs/RootTreeProfile.h"
 
 
 
@@ -90,6 +120,106 @@ namespace rs
 
   namespace file
   {
+    /*
+      Class lookup of the objects read by GetObj and GetObjList.
+      The TClass of each class name found on a key is resolved once and
+      cached, through the dictionary table of the loaded libraries, so that
+      the class name stored on a key can be checked before the object is
+      read and without going through the interpreter. Only class names
+      without a compiled dictionary fall back to TClass::GetClass, which
+      may autoload libraries; in the startup-optimized mode (see
+      SetStartupOptimized) they are skipped instead. A warning is printed
+      once for each class name that cannot be resolved, since its objects
+      are skipped by GetObjList.
+    */
+
+    inline Bool_t& StartupOptimizedFlag()
+    {
+      static Bool_t is_startup_optimized = kFALSE;
+      return is_startup_optimized;
+    }
+
+
+    inline void SetStartupOptimized(const Bool_t is_startup_optimized)
+    {
+      /*
+        Turns off header autoparsing of the interpreter and the fallback
+        class lookup, for short jobs that only read classes of the libraries
+        they are linked with.
+      */
+
+      static const Bool_t autoparsing_default = (
+        !gInterpreter->IsAutoParsingSuspended()
+      );
+      StartupOptimizedFlag() = is_startup_optimized;
+      gInterpreter->SetClassAutoparsing(
+        is_startup_optimized ? kFALSE : autoparsing_default
+      );
+    }
+
+
+    inline TClass* FindClass(const std::string& class_name)
+    {
+      static std::mutex mutex;
+      static std::unordered_map<std::string, TClass*> cache;
+      static std::unordered_set<std::string> unresolved;
+
+      std::lock_guard<std::mutex> lock(mutex);
+      auto iter = cache.find(class_name);
+      if (iter != cache.end()) {
+        return iter->second;
+      }
+
+      TClass* cl = nullptr;
+      if (DictFuncPtr_t dict = TClassTable::GetDict(class_name.c_str())) {
+        cl = dict();
+      } else if (!StartupOptimizedFlag()) {
+        cl = TClass::GetClass(class_name.c_str(), kTRUE, kTRUE);
+      }
+      // Unresolved names are not cached, a library may be loaded later.
+      if (cl) {
+        cache.emplace(class_name, cl);
+      } else if (unresolved.insert(class_name).second) {
+        std::cerr
+          << "Warning : unable to resolve the class " << class_name
+          << ((StartupOptimizedFlag())
+            ? " (no dictionary loaded, startup-optimized mode)"
+            : "")
+          << ", its objects are skipped."
+          << std::endl;
+      }
+      return cl;
+    }
+
+
+    template <typename TObjectLike>
+    TClass* GetClass()
+    {
+      rss::Assert_if_is_inheritance_of_TObject<TObjectLike>();
+
+      static TClass* cl = TClass::GetClass<TObjectLike>();
+      return cl;
+    }
+
+
+    template <typename TObjectLike>
+    Bool_t IsKeyOf(const TKey* key)
+    {
+      /*
+        Whether the object stored under key is a TObjectLike, from the class
+        name on the key only.
+      */
+
+      TClass* expected = GetClass<TObjectLike>();
+      const Char_t* class_name = key->GetClassName();
+      if (expected->GetName() == std::string(class_name)) {
+        return kTRUE;
+      }
+      TClass* cl = FindClass(class_name);
+      return cl && cl->InheritsFrom(expected);
+    }
+
+
     inline std::unique_ptr<TFile> Open(const Char_t* filepath)
     {
       FileStat_t info;
@@ -165,13 +295,27 @@ namespace rs
       rss::Assert_if_is_inheritance_of_TDirectory<TDirectoryLike>();
 
       TObjectLike* obj = nullptr;
-      dir->GetObject(name, obj);
+      const Bool_t is_plain_name = !std::strpbrk(name, "/;");
+      TKey* key = is_plain_name ? dir->GetKey(name) : nullptr;
+      if (key && !dir->GetList()->FindObject(name)) {
+        if (IsKeyOf<TObjectLike>(key)) {
+          obj = static_cast<TObjectLike*>(
+            key->ReadObjectAny(GetClass<TObjectLike>())
+          );
+        }
+      } else {
+        // Paths, cycles and objects in memory.
+        obj = static_cast<TObjectLike*>(
+          dir->GetObjectChecked(name, GetClass<TObjectLike>())
+        );
+      }
       if (!obj) {
         throw std::invalid_argument(
           std::string("No such object of ")
           + typeid(TObjectLike).name() + " : " + name
         );
       }
+      utils::Detach(obj);
       return std::unique_ptr<TObjectLike>(obj);
     }
 
@@ -192,11 +336,15 @@ namespace rs
           break;
         }
 
+        if (!IsKeyOf<TObjectLike>(key)) {
+          continue;
+        }
         auto* obj = static_cast<TObjectLike*>(
-          key->ReadObjectAny(TClass::GetClass<TObjectLike>())
+          key->ReadObjectAny(GetClass<TObjectLike>())
         );
         if (obj) {
           obj->SetName(key->GetName());
+          utils::Detach(obj);
           obj_list.push_back(std::unique_ptr<TObjectLike>(obj));
         }
       }
@@ -254,10 +402,192 @@ namespace rs
     }
 
 
+    template <typename TGraphLike = TGraph>
+    class GraphBuilder
+    {
+      /*
+        GraphBuilder replaces SetPoint(GetN(), ...) loops: points are pushed
+        into reserved contiguous buffers and copied into the graph once by
+        Build, which names and styles it as Create does.
+        With n_shards > 1, each thread pushes into its own GetShard(i);
+        shards are concatenated in index order by Build.
+      */
+
+    public:
+      class alignas(64) Shard
+      {
+      private:
+        std::vector<Double_t> x_;
+        std::vector<Double_t> y_;
+        std::vector<Double_t> ex_;
+        std::vector<Double_t> ey_;
+
+        friend class GraphBuilder;
+
+
+      public:
+        void Reserve(const std::size_t n)
+        {
+          x_.reserve(n);
+          y_.reserve(n);
+          if constexpr (std::is_base_of_v<TGraphErrors, TGraphLike>) {
+            ex_.reserve(n);
+            ey_.reserve(n);
+          }
+        }
+
+        void Push(const Double_t x, const Double_t y)
+        {
+          x_.push_back(x);
+          y_.push_back(y);
+          if constexpr (std::is_base_of_v<TGraphErrors, TGraphLike>) {
+            ex_.push_back(0.);
+            ey_.push_back(0.);
+          }
+        }
+
+        void Push(
+          const Double_t x, const Double_t y,
+          const Double_t ex, const Double_t ey
+        )
+        {
+          static_assert(
+            std::is_base_of_v<TGraphErrors, TGraphLike>,
+            "Points with errors require TGraphLike derived from TGraphErrors."
+          );
+
+          x_.push_back(x);
+          y_.push_back(y);
+          ex_.push_back(ex);
+          ey_.push_back(ey);
+        }
+
+        std::size_t GetN() const
+        {
+          return x_.size();
+        }
+      };
+
+
+    private:
+      std::string name_;
+      std::string title_;
+      std::string x_title_;
+      std::string y_title_;
+      Style_t style_;
+      std::vector<Shard> shards_;
+
+
+    public:
+      GraphBuilder() = delete;
+
+      GraphBuilder(
+        const Char_t* name,
+        const Char_t* title,
+        const Char_t* x_title,
+        const Char_t* y_title,
+        const Style_t style = kFullCircle,
+        const UInt_t n_shards = 1
+      )
+      : name_(name ? name : ""),
+        title_(title ? title : ""),
+        style_(style),
+        shards_(std::max(n_shards, 1u))
+      {
+        rss::Assert_if_is_inheritance_of_TGraph<TGraphLike>();
+
+        if (!(x_title && y_title)) {
+          throw std::invalid_argument(
+            "Both x_title and y_title must be provided."
+          );
+        }
+        x_title_ = x_title;
+        y_title_ = y_title;
+      }
+
+      ~GraphBuilder() = default;
+
+      GraphBuilder(const GraphBuilder& rh) = delete;
+
+      GraphBuilder(GraphBuilder&& rh) = default;
+
+      GraphBuilder& operator=(const GraphBuilder& rh) = delete;
+
+      GraphBuilder& operator=(GraphBuilder&& rh) = delete;
+
+
+      Shard& GetShard(const UInt_t i_shard)
+      {
+        return shards_.at(i_shard);
+      }
+
+      UInt_t GetNShards() const
+      {
+        return shards_.size();
+      }
+
+      void Reserve(const std::size_t n)
+      {
+        shards_[0].Reserve(n);
+      }
+
+      void Push(const Double_t x, const Double_t y)
+      {
+        shards_[0].Push(x, y);
+      }
+
+      void Push(
+        const Double_t x, const Double_t y,
+        const Double_t ex, const Double_t ey
+      )
+      {
+        shards_[0].Push(x, y, ex, ey);
+      }
+
+      std::size_t GetN() const
+      {
+        std::size_t n = 0;
+        for (const auto& shard : shards_) {
+          n += shard.GetN();
+        }
+        return n;
+      }
+
+      std::unique_ptr<TGraphLike> Build() const
+      {
+        const std::size_t n = GetN();
+        if (n > static_cast<std::size_t>(std::numeric_limits<Int_t>::max())) {
+          throw std::length_error("Too many points for a TGraph.");
+        }
+
+        auto g = std::move(Create<TGraphLike>(
+          n,
+          name_.empty() ? nullptr : name_.c_str(),
+          title_.empty() ? nullptr : title_.c_str(),
+          x_title_.c_str(),
+          y_title_.c_str(),
+          style_
+        ));
+
+        std::size_t offset = 0;
+        for (const auto& shard : shards_) {
+          std::copy(shard.x_.begin(), shard.x_.end(), g->GetX() + offset);
+          std::copy(shard.y_.begin(), shard.y_.end(), g->GetY() + offset);
+          if constexpr (std::is_base_of_v<TGraphErrors, TGraphLike>) {
+            std::copy(shard.ex_.begin(), shard.ex_.end(), g->GetEX() + offset);
+            std::copy(shard.ey_.begin(), shard.ey_.end(), g->GetEY() + offset);
+          }
+          offset += shard.GetN();
+        }
+        return std::move(g);
+      }
+    };
+
+
     template <typename TGraphLike>
     std::unique_ptr<TGraphLike> Create(const TGraphLike* g)
     {
-      return std::move(Create(
+      return std::move(Create<TGraphLike>(
         g->GetN(),
         g->GetName(),
         g->GetTitle(),
@@ -267,14 +597,201 @@ namespace rs
     }
 
 
+    template <typename TGraphLike>
+    Bool_t IsSortedX(const TGraphLike* g)
+    {
+      rss::Assert_if_is_inheritance_of_TGraph<TGraphLike>();
+
+      if (g->TestBit(TGraph::kIsSortedX)) {
+        return kTRUE;
+      }
+      const Int_t n = g->GetN();
+      const Double_t* x = g->GetX();
+      for (Int_t i = 1; i < n; ++i) {
+        if (x[i] < x[i - 1]) {
+          return kFALSE;
+        }
+      }
+      return kTRUE;
+    }
+
+
+    inline std::vector<Int_t> MakeSortPermutation(
+      const Double_t* key, const Int_t n
+    )
+    {
+      /*
+        Stable ascending order of key: chunks are sorted in parallel and
+        merged pairwise, level by level. Ties are ordered by index, and NaN
+        keys are placed after all numbers so that the comparison stays a
+        strict weak ordering.
+      */
+
+      using KeyIndex = std::pair<Double_t, Int_t>;
+      auto Is_less = [] (const KeyIndex& a, const KeyIndex& b)
+      {
+        const Bool_t is_nan_a = std::isnan(a.first);
+        const Bool_t is_nan_b = std::isnan(b.first);
+        if (is_nan_a != is_nan_b) {
+          return is_nan_b;
+        }
+        if (!is_nan_a && a.first != b.first) {
+          return a.first < b.first;
+        }
+        return a.second < b.second;
+      };
+
+      std::vector<KeyIndex> pairs(n);
+      for (Int_t i = 0; i < n; ++i) {
+        pairs[i] = {key[i], i};
+      }
+
+      const Int_t n_min_chunk = 1 << 16;
+      const Int_t n_chunks = std::max(
+        1, std::min<Int_t>(utils::GetNThreads(), n / n_min_chunk)
+      );
+      std::vector<Int_t> bounds(n_chunks + 1);
+      for (Int_t k = 0; k <= n_chunks; ++k) {
+        bounds[k] = static_cast<Int_t>(
+          static_cast<Long64_t>(n) * k / n_chunks
+        );
+      }
+
+      const auto begin = pairs.begin();
+      utils::ParallelFor(
+        0, n_chunks,
+        [&] (const Long64_t k_begin, const Long64_t k_end, UInt_t)
+        {
+          for (Long64_t k = k_begin; k < k_end; ++k) {
+            std::sort(begin + bounds[k], begin + bounds[k + 1], Is_less);
+          }
+        },
+        n_chunks
+      );
+      for (Int_t width = 1; width < n_chunks; width *= 2) {
+        const Int_t n_merges = (n_chunks + 2 * width - 1) / (2 * width);
+        utils::ParallelFor(
+          0, n_merges,
+          [&] (const Long64_t m_begin, const Long64_t m_end, UInt_t)
+          {
+            for (Long64_t m = m_begin; m < m_end; ++m) {
+              const Int_t k = 2 * width * m;
+              if (k + width >= n_chunks) {
+                continue;
+              }
+              std::inplace_merge(
+                begin + bounds[k],
+                begin + bounds[k + width],
+                begin + bounds[std::min(k + 2 * width, n_chunks)],
+                Is_less
+              );
+            }
+          },
+          n_merges
+        );
+      }
+
+      std::vector<Int_t> perm(n);
+      for (Int_t i = 0; i < n; ++i) {
+        perm[i] = pairs[i].second;
+      }
+      return perm;
+    }
+
+
+    inline void ApplyPermutation(
+      const std::vector<Int_t>& perm,
+      Double_t* arr,
+      std::vector<Double_t>& buffer
+    )
+    {
+      /*
+        arr[i] <- arr[perm[i]], gathered block by block into buffer so the
+        permutation and the output stay in cache, then copied back once all
+        blocks are done.
+      */
+
+      const Long64_t n = perm.size();
+      const Long64_t n_block = 1 << 14;
+      buffer.resize(n);
+      utils::ParallelFor(
+        0, (n + n_block - 1) / n_block,
+        [&] (const Long64_t b_begin, const Long64_t b_end, UInt_t)
+        {
+          for (Long64_t b = b_begin; b < b_end; ++b) {
+            const Long64_t i_end = std::min(n, (b + 1) * n_block);
+            for (Long64_t i = b * n_block; i < i_end; ++i) {
+              buffer[i] = arr[perm[i]];
+            }
+          }
+        }
+      );
+      std::copy(buffer.begin(), buffer.end(), arr);
+    }
+
+
     template <typename TGraphLike>
     void SortX(TGraphLike* g)
     {
+      /*
+        Already sorted input is detected and strictly decreasing input
+        (e.g. after InvertX) is reversed, both in O(n). Otherwise the
+        permutation of x is computed once and applied to every point array.
+        Graph classes with arrays unknown here fall back to TGraph::Sort.
+      */
+
       rss::Assert_if_is_inheritance_of_TGraph<TGraphLike>();
 
-      if (!(g->TestBit(TGraph::kIsSortedX))) {
+      if (g->TestBit(TGraph::kIsSortedX)) {
+        return;
+      }
+
+      const TClass* cl = g->IsA();
+      if (
+        !(
+          cl == TGraph::Class()
+          || cl == TGraphErrors::Class()
+          || cl == TGraphAsymmErrors::Class()
+        )
+      ) {
         g->Sort();
+        return;
+      }
+
+      const Int_t n = g->GetN();
+      const Double_t* x = g->GetX();
+      std::vector<Double_t*> columns;
+      for (
+        Double_t* col : {
+          g->GetX(), g->GetY(), g->GetEX(), g->GetEY(),
+          g->GetEXlow(), g->GetEXhigh(), g->GetEYlow(), g->GetEYhigh()
+        }
+      ) {
+        if (col) {
+          columns.push_back(col);
+        }
+      }
+
+      Bool_t is_sorted = kTRUE;
+      Bool_t is_reversed = kTRUE;
+      for (Int_t i = 1; i < n && (is_sorted || is_reversed); ++i) {
+        is_sorted = is_sorted && (x[i - 1] <= x[i]);
+        is_reversed = is_reversed && (x[i - 1] > x[i]);
+      }
+
+      if (is_reversed && !is_sorted) {
+        for (Double_t* col : columns) {
+          std::reverse(col, col + n);
+        }
+      } else if (!is_sorted) {
+        const std::vector<Int_t> perm = MakeSortPermutation(x, n);
+        std::vector<Double_t> buffer;
+        for (Double_t* col : columns) {
+          ApplyPermutation(perm, col, buffer);
+        }
       }
+      // NaN x-values end up last, and such a graph is not flagged sorted.
+      g->SetBit(TGraph::kIsSortedX, n == 0 || !std::isnan(x[n - 1]));
     }
 
 
@@ -388,20 +905,181 @@ namespace rs
         }
       }
 
+      // An empty graph is sorted and has no x-value to compare.
       const Bool_t is_sorted_x = (
-        g->TestBit(TGraph::kIsSortedX)
-        && g_pushed->TestBit(TGraph::kIsSortedX)
-        && (g->GetX()[n - 1] < x_pushed[0])
+        (n == 0 || g->TestBit(TGraph::kIsSortedX))
+        && (n_pushed == 0 || g_pushed->TestBit(TGraph::kIsSortedX))
+        && (n == 0 || n_pushed == 0 || g->GetX()[n - 1] < x_pushed[0])
       );
       g->SetBit(TGraph::kIsSortedX, is_sorted_x);
     }
 
 
+    class ColumnView
+    {
+      /*
+        Non-owning read-only view of one point array of a graph.
+      */
+
+    private:
+      const Double_t* data_;
+      std::size_t size_;
+
+
+    public:
+      ColumnView(const Double_t* data = nullptr, const std::size_t size = 0)
+      : data_(data), size_(data ? size : 0)
+      {
+      }
+
+      const Double_t* data() const
+      {
+        return data_;
+      }
+
+      std::size_t size() const
+      {
+        return size_;
+      }
+
+      Bool_t empty() const
+      {
+        return size_ == 0;
+      }
+
+      const Double_t& operator[](const std::size_t i) const
+      {
+        return data_[i];
+      }
+
+      const Double_t* begin() const
+      {
+        return data_;
+      }
+
+      const Double_t* end() const
+      {
+        return data_ + size_;
+      }
+    };
+
+
+    class GraphView
+    {
+      /*
+        Non-owning view of the point arrays of a graph, or of any two of its
+        columns used as (x, y). The viewed graph must outlive the view and
+        must not be resized while it is viewed. Materialize copies the view
+        into a real TGraph only when one is needed for drawing or writing.
+      */
+
+    private:
+      ColumnView x_;
+      ColumnView y_;
+      ColumnView ex_;
+      ColumnView ey_;
+      const Char_t* x_title_;
+      const Char_t* y_title_;
+
+
+    public:
+      GraphView(
+        const ColumnView x,
+        const ColumnView y,
+        const ColumnView ex = {},
+        const ColumnView ey = {},
+        const Char_t* x_title = "",
+        const Char_t* y_title = ""
+      )
+      : x_(x), y_(y), ex_(ex), ey_(ey), x_title_(x_title), y_title_(y_title)
+      {
+        if (x_.size() != y_.size()) {
+          throw std::invalid_argument("x and y columns differ in size.");
+        }
+      }
+
+      template <typename TGraphLike>
+      GraphView(const TGraphLike* g)
+      : GraphView(
+          {g->GetX(), static_cast<std::size_t>(g->GetN())},
+          {g->GetY(), static_cast<std::size_t>(g->GetN())},
+          {g->GetEX(), static_cast<std::size_t>(g->GetN())},
+          {g->GetEY(), static_cast<std::size_t>(g->GetN())},
+          g->GetXaxis()->GetTitle(),
+          g->GetYaxis()->GetTitle()
+        )
+      {
+        rss::Assert_if_is_inheritance_of_TGraph<TGraphLike>();
+      }
+
+      const ColumnView& x() const
+      {
+        return x_;
+      }
+
+      const ColumnView& y() const
+      {
+        return y_;
+      }
+
+      const ColumnView& ex() const
+      {
+        return ex_;
+      }
+
+      const ColumnView& ey() const
+      {
+        return ey_;
+      }
+
+      Int_t GetN() const
+      {
+        return x_.size();
+      }
+
+      std::unique_ptr<TGraph> Materialize() const
+      {
+        auto g = std::make_unique<TGraph>(GetN(), x_.data(), y_.data());
+        g->GetXaxis()->SetTitle(x_title_);
+        g->GetYaxis()->SetTitle(y_title_);
+        return std::move(g);
+      }
+
+      std::unique_ptr<TGraphErrors> MaterializeErrors() const
+      {
+        auto g = std::make_unique<TGraphErrors>(
+          GetN(), x_.data(), y_.data(), ex_.data(), ey_.data()
+        );
+        g->GetXaxis()->SetTitle(x_title_);
+        g->GetYaxis()->SetTitle(y_title_);
+        return std::move(g);
+      }
+    };
+
+
+    inline GraphView ViewErrX(const TGraphErrors* g)
+    {
+      const std::size_t n = g->GetN();
+      return GraphView(
+        {g->GetX(), n}, {g->GetEX(), n}, {}, {},
+        g->GetXaxis()->GetTitle(), ""
+      );
+    }
+
+
+    inline GraphView ViewErrY(const TGraphErrors* g)
+    {
+      const std::size_t n = g->GetN();
+      return GraphView(
+        {g->GetX(), n}, {g->GetEY(), n}, {}, {},
+        g->GetXaxis()->GetTitle(), ""
+      );
+    }
+
+
     inline std::unique_ptr<TGraph> FetchErrYGraph(const TGraphErrors* g)
     {
-      auto g_err = std::make_unique<TGraph>(g->GetN(), g->GetX(), g->GetEY());
-      g_err->GetXaxis()->SetTitle(g->GetXaxis()->GetTitle());
-      return std::move(g_err);
+      return std::move(ViewErrY(g).Materialize());
     }
 
 
@@ -471,227 +1149,2562 @@ namespace rs
     }
 
 
-    template <typename THasAxis>
-    void SetLimit(
-      THasAxis* obj,
-      const std::pair<Double_t, Double_t> x_limit = {0., 0.},
-      const std::pair<Double_t, Double_t> y_limit = {0., 0.}
+    template <typename TGraphLike>
+    std::unique_ptr<TGraphLike> MakeGraphDecimated(
+      const TGraphLike* g, const Int_t n_columns, const Bool_t log_x = kFALSE
     )
     {
-      static_assert(
-        (
-          std::is_base_of_v<TGraph, THasAxis>
-          || std::is_base_of_v<TH1, THasAxis>
-          || std::is_base_of_v<TMultiGraph, THasAxis>
-          || std::is_base_of_v<THStack, THasAxis>
-        ),
-        "Template parameter THasAxis must be derived from TGraph or TH1."
-      );
+      /*
+        Level-of-detail reduction for drawing (M4).
+        Points are binned into n_columns pixel columns along x, and only the
+        first, minimum, maximum and last points of each column are kept, in
+        their original order. The result has at most 4 * n_columns points,
+        and a polyline through it covers the same pixels as the polyline
+        through all points at a resolution of n_columns pixels, including
+        the segments between neighbouring columns. Markers and error bars
+        of the dropped points are lost, so the result is meant to be drawn
+        as a line only. x-values must be sorted.
+        Columns span the displayed range of the x-axis, i.e. the limits set
+        by SetLimit and any zoom, or the data range without an axis range.
+        Points on either side of it are reduced as one more column each,
+        and the axis ranges of g are copied to the result.
+      */
 
-      if (x_limit.first < x_limit.second) {
-        obj->GetXaxis()->SetLimits(x_limit.first, x_limit.second);
-      }
-      if (y_limit.first < y_limit.second) {
-        obj->SetMinimum(y_limit.first);
-        obj->SetMaximum(y_limit.second);
+      rss::Assert_if_is_inheritance_of_TGraph<TGraphLike>();
+
+      if (n_columns <= 0) {
+        throw std::invalid_argument("n_columns must be positive.");
       }
-    }
 
+      const Int_t n = g->GetN();
+      const Double_t* x = g->GetX();
+      const Double_t* y = g->GetY();
+      if (!IsSortedX(g)) {
+        throw std::invalid_argument(
+          "Unable to decimate graph with unsorted x-values."
+        );
+      }
+      if (log_x && n > 0 && x[0] <= 0) {
+        throw std::range_error(
+          "Unable to decimate graph with non-positive x-values in log scale."
+        );
+      }
 
-    template <typename THasAxis>
-    void SetLimitY(
-      THasAxis* obj, const std::pair<Double_t, Double_t> y_limit
-    )
-    {
-      SetLimit(obj, {0., 0.}, y_limit);
+      std::vector<Int_t> kept;
+      if (n <= 4 * n_columns) {
+        kept.resize(n);
+        for (Int_t i = 0; i < n; ++i) {
+          kept[i] = i;
+        }
+      } else {
+        auto To_pad = [log_x] (const Double_t val)
+        {
+          return log_x ? std::log10(val) : val;
+        };
+        const TAxis* x_axis = g->GetXaxis();
+        Double_t x_low = x_axis->GetBinLowEdge(x_axis->GetFirst());
+        Double_t x_up = x_axis->GetBinUpEdge(x_axis->GetLast());
+        if (!(x_low < x_up) || (log_x && x_low <= 0)) {
+          x_low = x[0];
+          x_up = x[n - 1];
+        }
+        const Double_t u_min = To_pad(x_low);
+        const Double_t u_max = To_pad(x_up);
+        const Double_t scale = (
+          (u_max > u_min) ? n_columns / (u_max - u_min) : 0.
+        );
+        // -1 and n_columns collect the points outside the displayed range.
+        auto Column_of = [&To_pad, u_min, u_max, scale, n_columns] (
+          const Double_t val
+        )
+        {
+          const Double_t u = To_pad(val);
+          if (u < u_min) {
+            return -1;
+          } else if (u > u_max) {
+            return n_columns;
+          }
+          return std::min(
+            static_cast<Int_t>((u - u_min) * scale), n_columns - 1
+          );
+        };
+
+        auto Keep_column = [&kept] (
+          const Int_t i_first, const Int_t i_min,
+          const Int_t i_max, const Int_t i_last
+        )
+        {
+          const Int_t indexes[4] = {
+            i_first, std::min(i_min, i_max), std::max(i_min, i_max), i_last
+          };
+          for (const Int_t i : indexes) {
+            if (kept.empty() || kept.back() < i) {
+              kept.push_back(i);
+            }
+          }
+        };
+
+        kept.reserve(4 * (n_columns + 2));
+        Int_t column = Column_of(x[0]);
+        Int_t i_first = 0;
+        Int_t i_min = 0;
+        Int_t i_max = 0;
+        for (Int_t i = 1; i < n; ++i) {
+          const Int_t column_i = Column_of(x[i]);
+          if (column_i != column) {
+            Keep_column(i_first, i_min, i_max, i - 1);
+            column = column_i;
+            i_first = i;
+            i_min = i;
+            i_max = i;
+          } else {
+            if (y[i] < y[i_min]) {
+              i_min = i;
+            }
+            if (y[i] > y[i_max]) {
+              i_max = i;
+            }
+          }
+        }
+        Keep_column(i_first, i_min, i_max, n - 1);
+      }
+
+      const Int_t n_kept = kept.size();
+      auto g_decimated = std::move(Create<TGraphLike>(
+        n_kept,
+        g->GetName(),
+        g->GetTitle(),
+        g->GetXaxis()->GetTitle(),
+        g->GetYaxis()->GetTitle(),
+        g->GetMarkerStyle()
+      ));
+      g->TAttLine::Copy(*g_decimated);
+      g->TAttFill::Copy(*g_decimated);
+      g->TAttMarker::Copy(*g_decimated);
+
+      Double_t* x_decimated = g_decimated->GetX();
+      Double_t* y_decimated = g_decimated->GetY();
+      for (Int_t i = 0; i < n_kept; ++i) {
+        x_decimated[i] = x[kept[i]];
+        y_decimated[i] = y[kept[i]];
+      }
+      if constexpr (std::is_base_of_v<TGraphErrors, TGraphLike>) {
+        const Double_t* ex = g->GetEX();
+        const Double_t* ey = g->GetEY();
+        Double_t* ex_decimated = g_decimated->GetEX();
+        Double_t* ey_decimated = g_decimated->GetEY();
+        for (Int_t i = 0; i < n_kept; ++i) {
+          ex_decimated[i] = ex[kept[i]];
+          ey_decimated[i] = ey[kept[i]];
+        }
+      }
+      g_decimated->SetBit(TGraph::kIsSortedX, kTRUE);
+
+      // After the points are set, since the axes of a graph are built from
+      // its points the first time they are accessed.
+      g_decimated->SetMinimum(g->GetMinimum());
+      g_decimated->SetMaximum(g->GetMaximum());
+      auto Copy_range = [] (const TAxis* axis, TAxis* axis_decimated)
+      {
+        axis_decimated->SetLimits(axis->GetXmin(), axis->GetXmax());
+        if (axis->GetFirst() > 1 || axis->GetLast() < axis->GetNbins()) {
+          axis_decimated->SetRangeUser(
+            axis->GetBinLowEdge(axis->GetFirst()),
+            axis->GetBinUpEdge(axis->GetLast())
+          );
+        }
+      };
+      Copy_range(g->GetXaxis(), g_decimated->GetXaxis());
+      Copy_range(g->GetYaxis(), g_decimated->GetYaxis());
+
+      return std::move(g_decimated);
+    }
+
+
+    template <typename TGraphLike = TGraph>
+    class ChunkedGraph
+    {
+      /*
+        ChunkedGraph is a disk-backed graph for series that do not fit in
+        memory. Points are stored in a TTree of the given directory, one
+        entry per chunk of up to chunk_size points, as the variable-length
+        columns x[n] and y[n] (and ex[n], ey[n] for TGraphErrors), which
+        ROOT compresses basket by basket. Each chunk also stores its x-range
+        and whether it is sorted, so that the x-range and the sortedness of
+        the whole graph are known without reading the points.
+        Only one chunk is held in memory; the tree title keeps
+        "title;x_title;y_title". The tree is owned by its directory.
+      */
+
+    private:
+      struct ChunkHeader
+      {
+        Int_t n = 0;
+        Double_t x_min = 0.;
+        Double_t x_max = 0.;
+        Bool_t is_sorted = kTRUE;
+      };
+
+      static constexpr Bool_t with_errors_ = (
+        std::is_base_of_v<TGraphErrors, TGraphLike>
+      );
+
+      TTree* tree_ = nullptr;
+      Int_t chunk_size_ = 0;
+      std::unique_ptr<ChunkHeader> header_;
+      std::vector<Double_t> x_;
+      std::vector<Double_t> y_;
+      std::vector<Double_t> ex_;
+      std::vector<Double_t> ey_;
+      Long64_t n_points_ = 0;
+      Double_t x_min_ = std::numeric_limits<Double_t>::infinity();
+      Double_t x_max_ = -std::numeric_limits<Double_t>::infinity();
+      Double_t x_last_ = -std::numeric_limits<Double_t>::infinity();
+      Bool_t is_sorted_x_ = kTRUE;
+      std::string name_;
+      std::string title_;
+      std::string x_title_;
+      std::string y_title_;
+
+
+    public:
+      ChunkedGraph() = delete;
+
+      ChunkedGraph(
+        TDirectory* dir,
+        const Char_t* name,
+        const Char_t* title,
+        const Char_t* x_title,
+        const Char_t* y_title,
+        const Int_t chunk_size = 1 << 16
+      )
+      : chunk_size_(chunk_size),
+        header_(std::make_unique<ChunkHeader>())
+      {
+        /*
+          Creates an empty graph in dir.
+        */
+
+        rss::Assert_if_is_inheritance_of_TGraph<TGraphLike>();
+
+        if (!name) {
+          throw std::invalid_argument("name must be provided.");
+        }
+        if (!(x_title && y_title)) {
+          throw std::invalid_argument(
+            "Both x_title and y_title must be provided."
+          );
+        }
+        if (chunk_size_ <= 0) {
+          throw std::invalid_argument("chunk_size must be positive.");
+        }
+        name_ = name;
+        title_ = title ? title : y_title;
+        x_title_ = x_title;
+        y_title_ = y_title;
+
+        TDirectory::TContext context(dir);
+        tree_ = new TTree(
+          name, (title_ + ";" + x_title_ + ";" + y_title_).c_str()
+        );
+        Resize();
+        tree_->Branch("n", &header_->n, "n/I");
+        tree_->Branch("x_min", &header_->x_min, "x_min/D");
+        tree_->Branch("x_max", &header_->x_max, "x_max/D");
+        tree_->Branch("is_sorted", &header_->is_sorted, "is_sorted/O");
+        tree_->Branch("x", x_.data(), "x[n]/D");
+        tree_->Branch("y", y_.data(), "y[n]/D");
+        if constexpr (with_errors_) {
+          tree_->Branch("ex", ex_.data(), "ex[n]/D");
+          tree_->Branch("ey", ey_.data(), "ey[n]/D");
+        }
+      }
+
+      ChunkedGraph(TDirectory* dir, const Char_t* name)
+      : header_(std::make_unique<ChunkHeader>())
+      {
+        /*
+          Opens a graph stored in dir. Only the chunk headers are read.
+        */
+
+        rss::Assert_if_is_inheritance_of_TGraph<TGraphLike>();
+
+        if (!name) {
+          throw std::invalid_argument("name must be provided.");
+        }
+        name_ = name;
+
+        dir->GetObject(name, tree_);
+        if (!tree_) {
+          throw std::invalid_argument(std::string("No such graph : ") + name);
+        }
+        if (with_errors_ && !tree_->GetBranch("ex")) {
+          throw std::invalid_argument(
+            std::string("This graph has no errors : ") + name
+          );
+        }
+
+        const std::string title = tree_->GetTitle();
+        const std::size_t pos_1 = title.find(';');
+        const std::size_t pos_2 = title.find(';', pos_1 + 1);
+        title_ = title.substr(0, pos_1);
+        if (pos_1 != std::string::npos) {
+          x_title_ = title.substr(pos_1 + 1, pos_2 - pos_1 - 1);
+        }
+        if (pos_2 != std::string::npos) {
+          y_title_ = title.substr(pos_2 + 1);
+        }
+
+        const std::vector<std::string> header_names = {
+          "n", "x_min", "x_max", "is_sorted"
+        };
+        std::vector<TBranch*> header_branches;
+        for (const auto& bname : header_names) {
+          header_branches.push_back(tree_->GetBranch(bname.c_str()));
+        }
+        tree_->SetBranchAddress("n", &header_->n);
+        tree_->SetBranchAddress("x_min", &header_->x_min);
+        tree_->SetBranchAddress("x_max", &header_->x_max);
+        tree_->SetBranchAddress("is_sorted", &header_->is_sorted);
+        for (Long64_t entry = 0; entry < tree_->GetEntries(); ++entry) {
+          for (TBranch* branch : header_branches) {
+            branch->GetEntry(entry);
+          }
+          if (header_->n == 0) {
+            continue;
+          }
+          chunk_size_ = std::max(chunk_size_, header_->n);
+          n_points_ += header_->n;
+          is_sorted_x_ = (
+            is_sorted_x_ && header_->is_sorted && header_->x_min >= x_last_
+          );
+          x_last_ = header_->x_max;
+          x_min_ = std::min(x_min_, header_->x_min);
+          x_max_ = std::max(x_max_, header_->x_max);
+        }
+        header_->n = 0;
+
+        chunk_size_ = std::max(chunk_size_, 1);
+        Resize();
+        tree_->SetBranchAddress("x", x_.data());
+        tree_->SetBranchAddress("y", y_.data());
+        if constexpr (with_errors_) {
+          tree_->SetBranchAddress("ex", ex_.data());
+          tree_->SetBranchAddress("ey", ey_.data());
+        }
+      }
+
+      ~ChunkedGraph() = default;
+
+      ChunkedGraph(const ChunkedGraph& rh) = delete;
+
+      ChunkedGraph(ChunkedGraph&& rh) = default;
+
+      ChunkedGraph& operator=(const ChunkedGraph& rh) = delete;
+
+      ChunkedGraph& operator=(ChunkedGraph&& rh) = delete;
+
+
+      void Push(const Double_t x, const Double_t y)
+      {
+        if (header_->n == chunk_size_) {
+          Flush();
+        }
+
+        const Int_t i = header_->n++;
+        x_[i] = x;
+        y_[i] = y;
+        if constexpr (with_errors_) {
+          ex_[i] = 0.;
+          ey_[i] = 0.;
+        }
+
+        if (i == 0) {
+          header_->x_min = x;
+          header_->x_max = x;
+          header_->is_sorted = kTRUE;
+        } else {
+          header_->is_sorted = header_->is_sorted && x >= x_[i - 1];
+          header_->x_min = std::min(header_->x_min, x);
+          header_->x_max = std::max(header_->x_max, x);
+        }
+        ++n_points_;
+        is_sorted_x_ = is_sorted_x_ && x >= x_last_;
+        x_last_ = x;
+        x_min_ = std::min(x_min_, x);
+        x_max_ = std::max(x_max_, x);
+      }
+
+      void Push(
+        const Double_t x, const Double_t y,
+        const Double_t ex, const Double_t ey
+      )
+      {
+        static_assert(
+          with_errors_,
+          "Points with errors require TGraphLike derived from TGraphErrors."
+        );
+
+        Push(x, y);
+        ex_[header_->n - 1] = ex;
+        ey_[header_->n - 1] = ey;
+      }
+
+      void PushN(
+        const Long64_t n,
+        const Double_t* x,
+        const Double_t* y,
+        const Double_t* ex = nullptr,
+        const Double_t* ey = nullptr
+      )
+      {
+        for (Long64_t i = 0; i < n; ++i) {
+          if constexpr (with_errors_) {
+            Push(x[i], y[i], ex ? ex[i] : 0., ey ? ey[i] : 0.);
+          } else {
+            Push(x[i], y[i]);
+          }
+        }
+      }
+
+      void Flush()
+      {
+        /*
+          Stores the pending points as a chunk, which may be shorter than
+          chunk_size.
+        */
+
+        if (header_->n > 0) {
+          tree_->Fill();
+          header_->n = 0;
+        }
+      }
+
+      Int_t Write()
+      {
+        Flush();
+        return tree_->Write("", TObject::kOverwrite);
+      }
+
+      template <typename Function>
+      void ForEachChunk(Function&& func)
+      {
+        /*
+          Calls func(x, y, ex, ey, n) for each chunk in order; ex and ey are
+          nullptr for TGraph. Pending points are flushed first.
+        */
+
+        Flush();
+        for (Long64_t entry = 0; entry < tree_->GetEntries(); ++entry) {
+          tree_->GetEntry(entry);
+          func(
+            x_.data(),
+            y_.data(),
+            with_errors_ ? ex_.data() : nullptr,
+            with_errors_ ? ey_.data() : nullptr,
+            header_->n
+          );
+        }
+        header_->n = 0;
+      }
+
+      std::unique_ptr<TGraphLike> MakeGraph(
+        const Double_t* x,
+        const Double_t* y,
+        const Double_t* ex,
+        const Double_t* ey,
+        const Int_t n
+      ) const
+      {
+        /*
+          An in-memory graph named and titled as this one, e.g. of a chunk.
+        */
+
+        auto g = std::move(Create<TGraphLike>(
+          n, name_.c_str(), title_.c_str(), x_title_.c_str(), y_title_.c_str()
+        ));
+        std::copy(x, x + n, g->GetX());
+        std::copy(y, y + n, g->GetY());
+        if constexpr (with_errors_) {
+          std::copy(ex, ex + n, g->GetEX());
+          std::copy(ey, ey + n, g->GetEY());
+        }
+        return std::move(g);
+      }
+
+      TTree* GetTree() const
+      {
+        return tree_;
+      }
+
+      Long64_t GetN() const
+      {
+        return n_points_;
+      }
+
+      Int_t GetChunkSize() const
+      {
+        return chunk_size_;
+      }
+
+      Bool_t IsSortedX() const
+      {
+        return is_sorted_x_;
+      }
+
+      std::pair<Double_t, Double_t> GetXRange() const
+      {
+        return {x_min_, x_max_};
+      }
+
+      const std::string& GetName() const
+      {
+        return name_;
+      }
+
+
+    private:
+      void Resize()
+      {
+        x_.resize(chunk_size_);
+        y_.resize(chunk_size_);
+        if constexpr (with_errors_) {
+          ex_.resize(chunk_size_);
+          ey_.resize(chunk_size_);
+        }
+      }
+    };
+
+
+    template <typename TGraphLike>
+    void PushGraph(
+      const TGraphLike* g_pushed, ChunkedGraph<TGraphLike>* g
+    )
+    {
+      const Double_t* ex = nullptr;
+      const Double_t* ey = nullptr;
+      if constexpr (std::is_base_of_v<TGraphErrors, TGraphLike>) {
+        ex = g_pushed->GetEX();
+        ey = g_pushed->GetEY();
+      }
+      g->PushN(g_pushed->GetN(), g_pushed->GetX(), g_pushed->GetY(), ex, ey);
+    }
+
+
+    template <typename TGraphLike>
+    void PushGraph(
+      ChunkedGraph<TGraphLike>* g_pushed, ChunkedGraph<TGraphLike>* g
+    )
+    {
+      if (g_pushed == g) {
+        throw std::invalid_argument("Unable to push a graph into itself.");
+      }
+      g_pushed->ForEachChunk(
+        [g] (
+          const Double_t* x, const Double_t* y,
+          const Double_t* ex, const Double_t* ey,
+          const Int_t n
+        )
+        {
+          g->PushN(n, x, y, ex, ey);
+        }
+      );
+    }
+
+
+    template <typename TGraphLike>
+    void InvertX(ChunkedGraph<TGraphLike>* g, ChunkedGraph<TGraphLike>* g_out)
+    {
+      /*
+        Streaming InvertX : each chunk of g is inverted by InvertX and
+        pushed into g_out.
+      */
+
+      if (g == g_out) {
+        throw std::invalid_argument("g_out must differ from g.");
+      }
+
+      g->ForEachChunk(
+        [g, g_out] (
+          const Double_t* x, const Double_t* y,
+          const Double_t* ex, const Double_t* ey,
+          const Int_t n
+        )
+        {
+          auto chunk = std::move(g->MakeGraph(x, y, ex, ey, n));
+          InvertX(chunk.get());
+          PushGraph(chunk.get(), g_out);
+        }
+      );
+    }
+
+
+    template <typename TGraphLike>
+    void LogY(ChunkedGraph<TGraphLike>* g, ChunkedGraph<TGraphLike>* g_out)
+    {
+      /*
+        Streaming LogY : each chunk of g is transformed by LogY and pushed
+        into g_out.
+      */
+
+      if (g == g_out) {
+        throw std::invalid_argument("g_out must differ from g.");
+      }
+
+      g->ForEachChunk(
+        [g, g_out] (
+          const Double_t* x, const Double_t* y,
+          const Double_t* ex, const Double_t* ey,
+          const Int_t n
+        )
+        {
+          auto chunk = std::move(g->MakeGraph(x, y, ex, ey, n));
+          LogY(chunk.get());
+          PushGraph(chunk.get(), g_out);
+        }
+      );
+    }
+
+
+    template <typename TGraphLike>
+    void MakeGraphCoarseGrained(
+      ChunkedGraph<TGraphLike>* g,
+      const Int_t step_grained,
+      ChunkedGraph<TGraphLike>* g_out
+    )
+    {
+      /*
+        Streaming MakeGraphCoarseGrained : groups of step_grained points
+        may span chunks, so the points left over by a chunk are carried
+        into the next one. As in memory, the last incomplete group is
+        dropped.
+      */
+
+      if (step_grained <= 0) {
+        throw std::invalid_argument("step_grained must be positive.");
+      }
+      if (g == g_out) {
+        throw std::invalid_argument("g_out must differ from g.");
+      }
+
+      std::vector<Double_t> x_carry;
+      std::vector<Double_t> y_carry;
+      std::vector<Double_t> ex_carry;
+      std::vector<Double_t> ey_carry;
+      g->ForEachChunk(
+        [&] (
+          const Double_t* x, const Double_t* y,
+          const Double_t* ex, const Double_t* ey,
+          const Int_t n
+        )
+        {
+          x_carry.insert(x_carry.end(), x, x + n);
+          y_carry.insert(y_carry.end(), y, y + n);
+          if (ex) {
+            ex_carry.insert(ex_carry.end(), ex, ex + n);
+            ey_carry.insert(ey_carry.end(), ey, ey + n);
+          }
+
+          const Int_t n_used = (
+            x_carry.size() / step_grained * step_grained
+          );
+          if (n_used == 0) {
+            return;
+          }
+          auto block = std::move(g->MakeGraph(
+            x_carry.data(), y_carry.data(),
+            ex_carry.data(), ey_carry.data(), n_used
+          ));
+          auto block_grained = std::move(
+            MakeGraphCoarseGrained(block.get(), step_grained)
+          );
+          PushGraph(block_grained.get(), g_out);
+
+          x_carry.erase(x_carry.begin(), x_carry.begin() + n_used);
+          y_carry.erase(y_carry.begin(), y_carry.begin() + n_used);
+          if (ex) {
+            ex_carry.erase(ex_carry.begin(), ex_carry.begin() + n_used);
+            ey_carry.erase(ey_carry.begin(), ey_carry.begin() + n_used);
+          }
+        }
+      );
+    }
+
+
+    template <typename TGraphLike>
+    std::unique_ptr<TGraphLike> MakeGraphDecimated(
+      ChunkedGraph<TGraphLike>* g,
+      const Int_t n_columns,
+      const Bool_t log_x = kFALSE
+    )
+    {
+      /*
+        Streaming MakeGraphDecimated : the same points are kept as by the
+        in-memory version, in one pass over the chunks, and only they are
+        materialized into an in-memory graph for drawing.
+      */
+
+      if (n_columns <= 0) {
+        throw std::invalid_argument("n_columns must be positive.");
+      }
+      if (!g->IsSortedX()) {
+        throw std::invalid_argument(
+          "Unable to decimate graph with unsorted x-values."
+        );
+      }
+      const auto [x_first, x_last] = g->GetXRange();
+      if (log_x && g->GetN() > 0 && x_first <= 0) {
+        throw std::range_error(
+          "Unable to decimate graph with non-positive x-values in log scale."
+        );
+      }
+
+      struct Point
+      {
+        Long64_t index;
+        Double_t x;
+        Double_t y;
+        Double_t ex;
+        Double_t ey;
+      };
+
+      const Long64_t n = g->GetN();
+      const Bool_t keep_all = (n <= 4 * n_columns);
+      auto To_pad = [log_x] (const Double_t val)
+      {
+        return log_x ? std::log10(val) : val;
+      };
+      const Double_t u_min = To_pad(x_first);
+      const Double_t u_max = To_pad(x_last);
+      const Double_t scale = (
+        (u_max > u_min) ? n_columns / (u_max - u_min) : 0.
+      );
+
+      std::vector<Point> kept;
+      kept.reserve(keep_all ? n : 4 * n_columns);
+      auto Keep = [&kept] (const Point& p)
+      {
+        if (kept.empty() || kept.back().index < p.index) {
+          kept.push_back(p);
+        }
+      };
+      auto Keep_column = [&Keep] (
+        const Point& p_first, const Point& p_min,
+        const Point& p_max, const Point& p_last
+      )
+      {
+        const Bool_t is_min_first = p_min.index < p_max.index;
+        Keep(p_first);
+        Keep(is_min_first ? p_min : p_max);
+        Keep(is_min_first ? p_max : p_min);
+        Keep(p_last);
+      };
+
+      Long64_t index = 0;
+      Int_t column = 0;
+      Point p_first{};
+      Point p_min{};
+      Point p_max{};
+      Point p_last{};
+      g->ForEachChunk(
+        [&] (
+          const Double_t* x, const Double_t* y,
+          const Double_t* ex, const Double_t* ey,
+          const Int_t n_chunk
+        )
+        {
+          for (Int_t i = 0; i < n_chunk; ++i, ++index) {
+            const Point p{
+              index, x[i], y[i], ex ? ex[i] : 0., ey ? ey[i] : 0.
+            };
+            if (keep_all) {
+              kept.push_back(p);
+              continue;
+            }
+            if (index == 0) {
+              p_first = p;
+              p_min = p;
+              p_max = p;
+              p_last = p;
+              continue;
+            }
+
+            Int_t column_i = static_cast<Int_t>((To_pad(p.x) - u_min) * scale);
+            if (column_i >= n_columns) {
+              column_i = n_columns - 1;
+            }
+            if (column_i != column) {
+              Keep_column(p_first, p_min, p_max, p_last);
+              column = column_i;
+              p_first = p;
+              p_min = p;
+              p_max = p;
+            } else {
+              if (p.y < p_min.y) {
+                p_min = p;
+              }
+              if (p.y > p_max.y) {
+                p_max = p;
+              }
+            }
+            p_last = p;
+          }
+        }
+      );
+      if (!keep_all) {
+        Keep_column(p_first, p_min, p_max, p_last);
+      }
+
+      const Int_t n_kept = kept.size();
+      std::vector<Double_t> x_kept(n_kept);
+      std::vector<Double_t> y_kept(n_kept);
+      std::vector<Double_t> ex_kept(n_kept);
+      std::vector<Double_t> ey_kept(n_kept);
+      for (Int_t i = 0; i < n_kept; ++i) {
+        x_kept[i] = kept[i].x;
+        y_kept[i] = kept[i].y;
+        ex_kept[i] = kept[i].ex;
+        ey_kept[i] = kept[i].ey;
+      }
+      auto g_decimated = std::move(g->MakeGraph(
+        x_kept.data(), y_kept.data(), ex_kept.data(), ey_kept.data(), n_kept
+      ));
+      g_decimated->SetBit(TGraph::kIsSortedX, kTRUE);
+      return std::move(g_decimated);
+    }
+
+
+    class Interpolator
+    {
+      /*
+        Linear interpolation on a sorted graph, as TGraph::Eval without
+        options, but with a uniform bucket index over x: the segment of a
+        point is found by a search restricted to one bucket, which is
+        near-constant for reasonably uniform x. Outside the x range the
+        first or last segment is extrapolated.
+      */
+
+    private:
+      std::vector<Double_t> x_;
+      std::vector<Double_t> y_;
+      std::vector<Double_t> slope_;
+      std::vector<Int_t> bucket_start_;
+      Double_t x_min_;
+      Double_t inv_width_;
+
+
+    public:
+      Interpolator() = delete;
+
+      template <typename TGraphLike>
+      Interpolator(const TGraphLike* g, const Int_t n_buckets = 0)
+      {
+        rss::Assert_if_is_inheritance_of_TGraph<TGraphLike>();
+
+        const Int_t n = g->GetN();
+        if (n < 2) {
+          throw std::invalid_argument(
+            std::string("At least two points are required : ") + g->GetName()
+          );
+        }
+        if (!IsSortedX(g)) {
+          throw std::invalid_argument(
+            std::string("x-values must be sorted (see SortX) : ")
+            + g->GetName()
+          );
+        }
+
+        x_.assign(g->GetX(), g->GetX() + n);
+        y_.assign(g->GetY(), g->GetY() + n);
+        slope_.resize(n - 1);
+        for (Int_t i = 0; i < n - 1; ++i) {
+          const Double_t dx = x_[i + 1] - x_[i];
+          slope_[i] = (dx > 0) ? (y_[i + 1] - y_[i]) / dx : 0.;
+        }
+
+        const Int_t n_bucket_used = (n_buckets > 0) ? n_buckets : n - 1;
+        x_min_ = x_.front();
+        const Double_t range = x_.back() - x_min_;
+        inv_width_ = (range > 0) ? n_bucket_used / range : 0.;
+
+        // bucket_start_[b] is the last segment starting at or below the
+        // lower edge of bucket b; one extra entry closes the last bucket.
+        bucket_start_.resize(n_bucket_used + 1);
+        Int_t i = 0;
+        for (Int_t b = 0; b < n_bucket_used; ++b) {
+          const Double_t edge = x_min_ + b / inv_width_;
+          while (i < n - 2 && x_[i + 1] <= edge) {
+            ++i;
+          }
+          bucket_start_[b] = i;
+        }
+        bucket_start_[n_bucket_used] = n - 2;
+        if (inv_width_ == 0.) {
+          std::fill(bucket_start_.begin(), bucket_start_.end(), 0);
+        }
+      }
+
+      ~Interpolator() = default;
+
+      Interpolator(const Interpolator& rh) = default;
+
+      Interpolator(Interpolator&& rh) = default;
+
+      Interpolator& operator=(const Interpolator& rh) = default;
+
+      Interpolator& operator=(Interpolator&& rh) = default;
+
+
+      Double_t Eval(const Double_t x) const
+      {
+        const Int_t i = FindSegment(x);
+        return y_[i] + slope_[i] * (x - x_[i]);
+      }
+
+      void Eval(const Double_t* x, Double_t* y, const std::size_t n) const
+      {
+        /*
+          Segments are looked up first, then the interpolation runs as a
+          separate branch-free loop the compiler can vectorize.
+        */
+
+        const std::size_t n_batch = 256;
+        Int_t segments[n_batch];
+        for (std::size_t begin = 0; begin < n; begin += n_batch) {
+          const std::size_t size = std::min(n_batch, n - begin);
+          for (std::size_t k = 0; k < size; ++k) {
+            segments[k] = FindSegment(x[begin + k]);
+          }
+          const Double_t* xs = x_.data();
+          const Double_t* ys = y_.data();
+          const Double_t* slopes = slope_.data();
+          for (std::size_t k = 0; k < size; ++k) {
+            const Int_t i = segments[k];
+            y[begin + k] = ys[i] + slopes[i] * (x[begin + k] - xs[i]);
+          }
+        }
+      }
+
+      void Eval(const std::vector<Double_t>& x, std::vector<Double_t>& y) const
+      {
+        y.resize(x.size());
+        Eval(x.data(), y.data(), x.size());
+      }
+
+      Int_t GetN() const
+      {
+        return x_.size();
+      }
+
+
+    private:
+      Int_t FindSegment(const Double_t x) const
+      {
+        const Double_t u = (x - x_min_) * inv_width_;
+        if (!(u > 0.)) {
+          return 0;
+        }
+        const Int_t n_bucket = bucket_start_.size() - 1;
+        const Int_t b = (u < n_bucket) ? static_cast<Int_t>(u) : n_bucket - 1;
+        const Int_t i_begin = bucket_start_[b];
+        const Int_t i_end = bucket_start_[b + 1];
+        return std::upper_bound(
+          x_.data() + i_begin + 1, x_.data() + i_end + 1, x
+        ) - x_.data() - 1;
+      }
+    };
+
+
+    template <typename THasAxis>
+    void SetLimit(
+      THasAxis* obj,
+      const std::pair<Double_t, Double_t> x_limit = {0., 0.},
+      const std::pair<Double_t, Double_t> y_limit = {0., 0.}
+    )
+    {
+      static_assert(
+        (
+          std::is_base_of_v<TGraph, THasAxis>
+          || std::is_base_of_v<TH1, THasAxis>
+          || std::is_base_of_v<TMultiGraph, THasAxis>
+          || std::is_base_of_v<THStack, THasAxis>
+        ),
+        "Template parameter THasAxis must be derived from TGraph or TH1."
+      );
+
+      if (x_limit.first < x_limit.second) {
+        obj->GetXaxis()->SetLimits(x_limit.first, x_limit.second);
+      }
+      if (y_limit.first < y_limit.second) {
+        obj->SetMinimum(y_limit.first);
+        obj->SetMaximum(y_limit.second);
+      }
+    }
+
+
+    template <typename THasAxis>
+    void SetLimitY(
+      THasAxis* obj, const std::pair<Double_t, Double_t> y_limit
+    )
+    {
+      SetLimit(obj, {0., 0.}, y_limit);
+    }
+  }
+
+
+  namespace draw
+  {
+    // inline void SetLogX(TCanvas* c)
+    // {
+    //   c->SetLogx();
+    // }
+
+
+    // inline void SetLogY(TCanvas* c)
+    // {
+    //   c->SetLogy();
+    // }
+
+
+    inline void DrawLine(
+      TCanvas* c,
+      std::pair<Double_t, Double_t> point_1,
+      const std::pair<Double_t, Double_t> point_2,
+      const Color_t color = kBlack,
+      const Style_t style = kDashed,
+      const Width_t width = 0
+    )
+    {
+      auto l = new TLine(
+        point_1.first, point_1.second, point_2.first, point_2.second
+      );
+      l->SetLineColor(color);
+      l->SetLineStyle(style);
+      if (width > 0) {
+        l->SetLineWidth(width);
+      }
+      c->cd();
+      l->Draw();
+    }
+
+
+    inline void DrawLineVertical(
+      TCanvas* c,
+      const Double_t x,
+      const Color_t color = kBlack,
+      const Style_t style = kDashed,
+      const Width_t width = 0
+    )
+    {
+      c->Update();
+      DrawLine(c, {x, c->GetUymin()}, {x, c->GetUymax()}, color, style, width);
+    }
+
+
+    inline void DrawLineHorizontal(
+      TCanvas* c,
+      const Double_t y,
+      const Color_t color = kBlack,
+      const Style_t style = kDashed,
+      const Width_t width = 0
+    )
+    {
+      c->Update();
+      DrawLine(c, {c->GetUxmin(), y}, {c->GetUxmax(), y}, color, style, width);
+    }
+
+
+    class AnnotationBatch
+    {
+      /*
+        AnnotationBatch collects lines, boxes and texts and draws them in one
+        go. Vertical/horizontal lines and NDC boxes need the user range of
+        the pad, which is resolved by a single Update in Draw instead of one
+        per annotation as in DrawLineVertical/DrawLineHorizontal.
+        The batch owns its primitives, so it must outlive the last paint or
+        save of the canvas it was drawn on.
+      */
+
+    private:
+      enum class Span
+      {
+        kNone,
+        kVertical,
+        kHorizontal
+      };
+
+      struct LineEntry
+      {
+        std::unique_ptr<TLine> line;
+        Span span;
+      };
+
+      struct BoxEntry
+      {
+        std::unique_ptr<TBox> box;
+        Bool_t is_ndc;
+      };
+
+      std::vector<LineEntry> lines_;
+      std::vector<BoxEntry> boxes_;
+      std::vector<std::unique_ptr<TLatex>> texts_;
+
+
+    public:
+      AnnotationBatch() = default;
+
+      ~AnnotationBatch() = default;
+
+      AnnotationBatch(const AnnotationBatch& rh) = delete;
+
+      AnnotationBatch(AnnotationBatch&& rh) = default;
+
+      AnnotationBatch& operator=(const AnnotationBatch& rh) = delete;
+
+      AnnotationBatch& operator=(AnnotationBatch&& rh) = delete;
+
+
+      void AddLine(
+        const std::pair<Double_t, Double_t> point_1,
+        const std::pair<Double_t, Double_t> point_2,
+        const Color_t color = kBlack,
+        const Style_t style = kDashed,
+        const Width_t width = 0
+      )
+      {
+        PushLine(point_1, point_2, Span::kNone, color, style, width);
+      }
+
+      void AddLineNDC(
+        const std::pair<Double_t, Double_t> point_1,
+        const std::pair<Double_t, Double_t> point_2,
+        const Color_t color = kBlack,
+        const Style_t style = kDashed,
+        const Width_t width = 0
+      )
+      {
+        PushLine(point_1, point_2, Span::kNone, color, style, width);
+        lines_.back().line->SetNDC();
+      }
+
+      void AddLineVertical(
+        const Double_t x,
+        const Color_t color = kBlack,
+        const Style_t style = kDashed,
+        const Width_t width = 0
+      )
+      {
+        PushLine({x, 0.}, {x, 0.}, Span::kVertical, color, style, width);
+      }
+
+      void AddLineHorizontal(
+        const Double_t y,
+        const Color_t color = kBlack,
+        const Style_t style = kDashed,
+        const Width_t width = 0
+      )
+      {
+        PushLine({0., y}, {0., y}, Span::kHorizontal, color, style, width);
+      }
+
+      void AddBox(
+        const std::pair<Double_t, Double_t> point_1,
+        const std::pair<Double_t, Double_t> point_2,
+        const Color_t color = kBlack,
+        const Style_t fill_style = 0,
+        const Bool_t is_ndc = kFALSE
+      )
+      {
+        auto b = std::make_unique<TBox>(
+          point_1.first, point_1.second, point_2.first, point_2.second
+        );
+        b->SetLineColor(color);
+        b->SetFillColor(color);
+        b->SetFillStyle(fill_style);
+        boxes_.push_back({std::move(b), is_ndc});
+      }
+
+      void AddText(
+        const std::pair<Double_t, Double_t> point,
+        const Char_t* text,
+        const Color_t color = kBlack,
+        const Float_t size = 0.,
+        const Bool_t is_ndc = kFALSE
+      )
+      {
+        auto t = std::make_unique<TLatex>(point.first, point.second, text);
+        t->SetTextColor(color);
+        if (size > 0) {
+          t->SetTextSize(size);
+        }
+        t->SetNDC(is_ndc);
+        texts_.push_back(std::move(t));
+      }
+
+      std::size_t GetSize() const
+      {
+        return lines_.size() + boxes_.size() + texts_.size();
+      }
+
+      void Clear()
+      {
+        lines_.clear();
+        boxes_.clear();
+        texts_.clear();
+      }
+
+      void Draw(TCanvas* c)
+      {
+        c->cd();
+
+        Bool_t needs_range = kFALSE;
+        for (const auto& entry : lines_) {
+          needs_range = needs_range || (entry.span != Span::kNone);
+        }
+        for (const auto& entry : boxes_) {
+          needs_range = needs_range || entry.is_ndc;
+        }
+        if (needs_range) {
+          c->Update();
+        }
+
+        // Pad ranges are log10 of the user coordinates on log axes.
+        auto To_user_x = [c] (const Double_t u)
+        {
+          return c->GetLogx() ? std::pow(10., u) : u;
+        };
+        auto To_user_y = [c] (const Double_t u)
+        {
+          return c->GetLogy() ? std::pow(10., u) : u;
+        };
+
+        for (auto& entry : lines_) {
+          TLine* l = entry.line.get();
+          if (entry.span == Span::kVertical) {
+            l->SetY1(To_user_y(c->GetUymin()));
+            l->SetY2(To_user_y(c->GetUymax()));
+          } else if (entry.span == Span::kHorizontal) {
+            l->SetX1(To_user_x(c->GetUxmin()));
+            l->SetX2(To_user_x(c->GetUxmax()));
+          }
+          l->Draw();
+        }
+
+        for (auto& entry : boxes_) {
+          TBox* b = entry.box.get();
+          if (entry.is_ndc) {
+            auto Ndc_to_x = [&] (const Double_t ndc)
+            {
+              return To_user_x(c->GetX1() + ndc * (c->GetX2() - c->GetX1()));
+            };
+            auto Ndc_to_y = [&] (const Double_t ndc)
+            {
+              return To_user_y(c->GetY1() + ndc * (c->GetY2() - c->GetY1()));
+            };
+            b->SetX1(Ndc_to_x(b->GetX1()));
+            b->SetX2(Ndc_to_x(b->GetX2()));
+            b->SetY1(Ndc_to_y(b->GetY1()));
+            b->SetY2(Ndc_to_y(b->GetY2()));
+            entry.is_ndc = kFALSE;
+          }
+          b->Draw();
+        }
+
+        for (auto& t : texts_) {
+          t->Draw();
+        }
+
+        c->Modified();
+      }
+
+
+    private:
+      void PushLine(
+        const std::pair<Double_t, Double_t> point_1,
+        const std::pair<Double_t, Double_t> point_2,
+        const Span span,
+        const Color_t color,
+        const Style_t style,
+        const Width_t width
+      )
+      {
+        auto l = std::make_unique<TLine>(
+          point_1.first, point_1.second, point_2.first, point_2.second
+        );
+        l->SetLineColor(color);
+        l->SetLineStyle(style);
+        if (width > 0) {
+          l->SetLineWidth(width);
+        }
+        lines_.push_back({std::move(l), span});
+      }
+    };
+
+
+    template <typename TObjectLike>
+    void SetStatsPosition(TObjectLike* obj, const Char_t stats_position)
+    {
+      /*
+        The stats box exists only after the pad has been updated.
+      */
+
+      TPaveStats* stats = dynamic_cast<TPaveStats*>(
+        obj->GetListOfFunctions()->FindObject("stats")
+      );
+      if (stats) {
+        if (stats_position == 'U') {
+          stats->SetX1NDC(0.98);
+          stats->SetY1NDC(0.94);
+          stats->SetX2NDC(0.73);
+          stats->SetY2NDC(0.79);
+        } else if (stats_position == 'L') {
+          stats->SetX1NDC(0.98);
+          stats->SetY1NDC(0.34);
+          stats->SetX2NDC(0.73);
+          stats->SetY2NDC(0.19);
+        }
+      }
+    }
+
+
+    inline Bool_t IsDrawnAsLineOnly(
+      Option_t* /* = const Char_t* */ opt, const Bool_t with_errors
+    )
+    {
+      /*
+        Whether a graph drawn with opt shows a polyline (L or C) and no
+        markers (P, *), bars (B) or error bars, which graphs with errors
+        draw unless X is given.
+      */
+
+      const Char_t* o = opt ? opt : "";
+      const Bool_t with_line = std::strpbrk(o, "LlCc") != nullptr;
+      const Bool_t with_marker = std::strpbrk(o, "Pp*Bb") != nullptr;
+      const Bool_t hides_errors = std::strpbrk(o, "Xx") != nullptr;
+      return with_line && !with_marker && (!with_errors || hides_errors);
+    }
+
+
+    inline Bool_t IsRootFilepath(const Char_t* filepath)
+    {
+      return std::filesystem::path(filepath).extension() == ".root";
+    }
+
+
+    template <typename TObjectLike>
+    std::unique_ptr<TObjectLike> MakeDecimatedForDrawing(
+      const TObjectLike* obj,
+      const TCanvas* c,
+      Option_t* /* = const Char_t* */ opt
+    )
+    {
+      /*
+        graph::MakeGraphDecimated at the pixel width of c, for a graph with
+        sorted x-values that is drawn as a line only. nullptr otherwise,
+        i.e. when obj has to be drawn as it is.
+      */
+
+      if constexpr (std::is_base_of_v<TGraph, TObjectLike>) {
+        const Bool_t with_errors = (
+          obj->GetEX() || obj->GetEY() || obj->GetEXlow() || obj->GetEYlow()
+        );
+        if (IsDrawnAsLineOnly(opt, with_errors) && graph::IsSortedX(obj)) {
+          return std::move(
+            graph::MakeGraphDecimated(obj, c->GetWw(), c->GetLogx())
+          );
+        }
+      }
+      return nullptr;
+    }
+
+
+    template <typename TObjectLike, typename TDirectoryLike>
+    void FastSaveToRoot(
+      TObjectLike* obj,
+      TDirectoryLike* dir,
+      Option_t* /* = const Char_t* */ opt,
+      const Bool_t with_legend = kFALSE,
+      const std::tuple<
+        Double_t, Double_t, Double_t, Double_t
+      > legend_position = {0.3, 0.21, 0.3, 0.21}
+    )
+    {
+      rss::Assert_if_is_inheritance_of_TObject<TObjectLike>();
+      rss::Assert_if_is_inheritance_of_TDirectory<TDirectoryLike>();
+
+      auto c = std::make_unique<TCanvas>(obj->GetName(), obj->GetTitle());
+      c->cd();
+      obj->Draw(opt);
+      if (with_legend) {
+        const double& x_1 = std::get<0>(legend_position);
+        const double& y_1 = std::get<1>(legend_position);
+        const double& x_2 = std::get<2>(legend_position);
+        const double& y_2 = std::get<3>(legend_position);
+        c->BuildLegend(x_1, y_1, x_2, y_2);
+      }
+      dir->cd();
+      c->Write();
+    }
+
+
+    template <typename TObjectLike>
+    void FastSaveToFile(
+      TObjectLike* obj,
+      const Char_t* filepath,
+      Option_t* /* = const Char_t* */ opt,
+      const Char_t stats_position = 'U',
+      const Bool_t with_legend = kFALSE,
+      const std::tuple<
+        Double_t, Double_t, Double_t, Double_t
+      > legend_position = {0.3, 0.21, 0.3, 0.21},
+      const Bool_t level_of_detail = kFALSE
+    )
+    {
+      /*
+        With level_of_detail, a graph drawn as a line only is replaced by
+        MakeDecimatedForDrawing before drawing, unless filepath is a ROOT
+        file, which would keep the decimated points.
+      */
+
+      rss::Assert_if_is_inheritance_of_TObject<TObjectLike>();
+
+      auto c = std::make_unique<TCanvas>(obj->GetName(), obj->GetTitle());
+      std::unique_ptr<TObjectLike> obj_decimated;
+      if (level_of_detail && !IsRootFilepath(filepath)) {
+        obj_decimated = MakeDecimatedForDrawing(obj, c.get(), opt);
+      }
+      TObjectLike* obj_drawn = obj_decimated ? obj_decimated.get() : obj;
+      obj_drawn->Draw(opt);
+      if (with_legend) {
+        const double& x_1 = std::get<0>(legend_position);
+        const double& y_1 = std::get<1>(legend_position);
+        const double& x_2 = std::get<2>(legend_position);
+        const double& y_2 = std::get<3>(legend_position);
+        c->BuildLegend(x_1, y_1, x_2, y_2);
+      }
+
+      c->Update();
+      SetStatsPosition(obj_drawn, stats_position);
+
+      c->SaveAs(filepath);
+    }
+
+
+    template <typename TObjectLike>
+    void FastSaveToFile(
+      TObjectLike* obj,
+      const std::filesystem::path& filepath,
+      Option_t* /* = const Char_t* */ opt,
+      const Char_t stats_position = 'U',
+      const Bool_t with_legend = kFALSE,
+      const std::tuple<
+        Double_t, Double_t, Double_t, Double_t
+      > legend_position = {0.3, 0.21, 0.3, 0.21},
+      const Bool_t level_of_detail = kFALSE
+    )
+    {
+      FastSaveToFile(
+        obj, filepath.c_str(), opt,
+        stats_position, with_legend, legend_position, level_of_detail
+      );
+    }
+
+
+    class CanvasPool
+    {
+      /*
+        CanvasPool keeps one canvas per (width, height, gStyle name) and
+        clears it between objects instead of constructing a new TCanvas for
+        every save. A reused canvas takes the current attributes of gStyle
+        again. A legend with an explicit position is also reused; the
+        automatic placement of TPad::BuildLegend (x_1 == x_2) still builds a
+        fresh one.
+
+        With SetLevelOfDetail(kTRUE), FastSaveToFile replaces graphs drawn
+        as lines only by MakeDecimatedForDrawing before drawing, unless the
+        canvas is saved as a ROOT file. FastSaveToRoot always draws obj
+        itself, because the written canvas keeps the drawn points.
+      */
+
+    public:
+      using KeyType = std::tuple<Int_t, Int_t, std::string>;
+
+
+    private:
+      struct Slot
+      {
+        std::string pool_name;
+        std::unique_ptr<TCanvas> canvas;
+      };
+
+      Int_t width_;
+      Int_t height_;
+      Bool_t level_of_detail_ = kFALSE;
+      std::unique_ptr<TLegend> legend_;
+      std::map<KeyType, Slot> slots_;
+      Slot* current_ = nullptr;
+
+
+    public:
+      CanvasPool(const Int_t width = 0, const Int_t height = 0)
+      : width_(width),
+        height_(height),
+        legend_(std::make_unique<TLegend>(0.3, 0.21, 0.3, 0.21))
+      {
+      }
+
+      ~CanvasPool() = default;
+
+      CanvasPool(const CanvasPool& rh) = delete;
+
+      CanvasPool(CanvasPool&& rh) = default;
+
+      CanvasPool& operator=(const CanvasPool& rh) = delete;
+
+      CanvasPool& operator=(CanvasPool&& rh) = delete;
+
+
+      TCanvas* Acquire(const Char_t* name, const Char_t* title)
+      {
+        Release();
+
+        const Int_t width = (width_ > 0) ? width_ : gStyle->GetCanvasDefW();
+        const Int_t height = (height_ > 0) ? height_ : gStyle->GetCanvasDefH();
+        Slot& slot = slots_[KeyType(width, height, gStyle->GetName())];
+        if (!slot.canvas) {
+          // Pooled canvases must not share a name with any user canvas,
+          // because TCanvas deletes an existing canvas of the same name.
+          static std::atomic<Int_t> n_created{0};
+          slot.pool_name = "rs_canvas_pool_" + std::to_string(n_created++);
+          slot.canvas = std::make_unique<TCanvas>(
+            slot.pool_name.c_str(), title, width, height
+          );
+        } else {
+          // gStyle may have been modified without being renamed.
+          slot.canvas->UseCurrentStyle();
+        }
+
+        slot.canvas->SetName(name);
+        slot.canvas->SetTitle(title);
+        slot.canvas->cd();
+        current_ = &slot;
+        return slot.canvas.get();
+      }
+
+      void Release()
+      {
+        if (current_) {
+          current_->canvas->GetListOfPrimitives()->Remove(legend_.get());
+          current_->canvas->Clear();
+          current_->canvas->SetName(current_->pool_name.c_str());
+          current_ = nullptr;
+        }
+        legend_->Clear();
+      }
+
+      void SetLevelOfDetail(const Bool_t level_of_detail)
+      {
+        level_of_detail_ = level_of_detail;
+      }
+
+      std::size_t GetSize() const
+      {
+        return slots_.size();
+      }
+
+
+      template <typename TObjectLike, typename TDirectoryLike>
+      void FastSaveToRoot(
+        TObjectLike* obj,
+        TDirectoryLike* dir,
+        Option_t* /* = const Char_t* */ opt,
+        const Bool_t with_legend = kFALSE,
+        const std::tuple<
+          Double_t, Double_t, Double_t, Double_t
+        > legend_position = {0.3, 0.21, 0.3, 0.21}
+      )
+      {
+        rss::Assert_if_is_inheritance_of_TObject<TObjectLike>();
+        rss::Assert_if_is_inheritance_of_TDirectory<TDirectoryLike>();
+
+        // No level of detail : the canvas is stored with what it draws.
+        TCanvas* c = Acquire(obj->GetName(), obj->GetTitle());
+        obj->Draw(opt);
+        if (with_legend) {
+          DrawLegend(c, legend_position);
+        }
+        dir->cd();
+        c->Write();
+        Release();
+      }
+
+
+      template <typename TObjectLike>
+      void FastSaveToFile(
+        TObjectLike* obj,
+        const Char_t* filepath,
+        Option_t* /* = const Char_t* */ opt,
+        const Char_t stats_position = 'U',
+        const Bool_t with_legend = kFALSE,
+        const std::tuple<
+          Double_t, Double_t, Double_t, Double_t
+        > legend_position = {0.3, 0.21, 0.3, 0.21}
+      )
+      {
+        rss::Assert_if_is_inheritance_of_TObject<TObjectLike>();
+
+        TCanvas* c = Acquire(obj->GetName(), obj->GetTitle());
+        auto obj_decimated = MakeDecimated(obj, c, opt, filepath);
+        TObjectLike* obj_drawn = obj_decimated ? obj_decimated.get() : obj;
+        obj_drawn->Draw(opt);
+        if (with_legend) {
+          DrawLegend(c, legend_position);
+        }
+
+        c->Update();
+        SetStatsPosition(obj_drawn, stats_position);
+
+        c->SaveAs(filepath);
+        Release();
+      }
+
+
+      template <typename TObjectLike>
+      void FastSaveToFile(
+        TObjectLike* obj,
+        const std::filesystem::path& filepath,
+        Option_t* /* = const Char_t* */ opt,
+        const Char_t stats_position = 'U',
+        const Bool_t with_legend = kFALSE,
+        const std::tuple<
+          Double_t, Double_t, Double_t, Double_t
+        > legend_position = {0.3, 0.21, 0.3, 0.21}
+      )
+      {
+        FastSaveToFile(
+          obj, filepath.c_str(), opt,
+          stats_position, with_legend, legend_position
+        );
+      }
+
+
+    private:
+      template <typename TObjectLike>
+      std::unique_ptr<TObjectLike> MakeDecimated(
+        const TObjectLike* obj,
+        const TCanvas* c,
+        Option_t* /* = const Char_t* */ opt,
+        const Char_t* filepath
+      ) const
+      {
+        if (!level_of_detail_ || IsRootFilepath(filepath)) {
+          return nullptr;
+        }
+        return MakeDecimatedForDrawing(obj, c, opt);
+      }
+
+      void DrawLegend(
+        TCanvas* c,
+        const std::tuple<
+          Double_t, Double_t, Double_t, Double_t
+        >& legend_position
+      )
+      {
+        const double& x_1 = std::get<0>(legend_position);
+        const double& y_1 = std::get<1>(legend_position);
+        const double& x_2 = std::get<2>(legend_position);
+        const double& y_2 = std::get<3>(legend_position);
+        if (x_1 == x_2) {
+          c->BuildLegend(x_1, y_1, x_2, y_2);
+          return;
+        }
+
+        legend_->Clear();
+        legend_->SetX1NDC(x_1);
+        legend_->SetY1NDC(y_1);
+        legend_->SetX2NDC(x_2);
+        legend_->SetY2NDC(y_2);
+
+        TIter prim_iter(c->GetListOfPrimitives());
+        while (true) {
+          TObject* prim = prim_iter();
+          if (!prim) {
+            break;
+          }
+
+          if (auto* mg = dynamic_cast<TMultiGraph*>(prim)) {
+            TIter g_iter(mg->GetListOfGraphs());
+            while (TObject* g = g_iter()) {
+              legend_->AddEntry(g, g->GetTitle(), "lp");
+            }
+          } else if (auto* hs = dynamic_cast<THStack*>(prim)) {
+            TIter h_iter(hs->GetHists());
+            while (TObject* h = h_iter()) {
+              legend_->AddEntry(h, h->GetTitle(), "lf");
+            }
+          } else if (dynamic_cast<TGraph*>(prim)) {
+            legend_->AddEntry(prim, prim->GetTitle(), "lp");
+          } else if (dynamic_cast<TH1*>(prim)) {
+            legend_->AddEntry(prim, prim->GetTitle(), "lf");
+          }
+        }
+        legend_->Draw();
+      }
+    };
+  }
+
+
+  namespace mul
+  {
+    inline void SetByFirstObject(const std::unique_ptr<TMultiGraph>& mg)
+    {
+      if (mg->GetListOfGraphs()->GetEntries() == 0) {
+        throw std::invalid_argument(
+          std::string("No graphs in this TMultiGraph : ") + mg->GetName()
+        );
+      }
+
+      auto* g = static_cast<TGraph*>(mg->GetListOfGraphs()->At(0));
+      mg->GetXaxis()->SetTitle(g->GetXaxis()->GetTitle());
+      mg->GetYaxis()->SetTitle(g->GetYaxis()->GetTitle());
+    }
+
+
+    inline void SetByFirstObject(const std::unique_ptr<THStack>& hs)
+    {
+      if (hs->GetHists()->GetEntries() == 0) {
+        throw std::invalid_argument(
+          std::string("No histograms in this THStack : ") + hs->GetName()
+        );
+      }
+
+      auto* h = static_cast<TH1*>(hs->GetHists()->At(0));
+      hs->GetXaxis()->SetTitle(h->GetXaxis()->GetTitle());
+      hs->GetYaxis()->SetTitle(h->GetYaxis()->GetTitle());
+    }
+
+
+    template <typename TObjectRange>
+    std::pair<std::pair<Double_t, Double_t>, std::pair<Double_t, Double_t>>
+    GetLimits(const TObjectRange& objs)
+    {
+      /*
+        Global {x_limit, y_limit} of a range of (smart) pointers to TGraph or
+        TH1, including errors, computed in one pass over the point arrays or
+        bin contents. The y-limits are those of the overlaid (not stacked)
+        objects.
+      */
+
+      Double_t x_min = std::numeric_limits<Double_t>::infinity();
+      Double_t x_max = -std::numeric_limits<Double_t>::infinity();
+      Double_t y_min = std::numeric_limits<Double_t>::infinity();
+      Double_t y_max = -std::numeric_limits<Double_t>::infinity();
+
+      for (const auto& obj : objs) {
+        using TObjectLike = std::remove_pointer_t<decltype(&*obj)>;
+        static_assert(
+          (
+            std::is_base_of_v<TGraph, TObjectLike>
+            || std::is_base_of_v<TH1, TObjectLike>
+          ),
+          "Elements of TObjectRange must point to TGraph or TH1."
+        );
+
+        if constexpr (std::is_base_of_v<TGraph, TObjectLike>) {
+          const Int_t n = obj->GetN();
+          const Double_t* x = obj->GetX();
+          const Double_t* y = obj->GetY();
+          const Double_t* ex = obj->GetEX();
+          const Double_t* ey = obj->GetEY();
+          for (Int_t i = 0; i < n; ++i) {
+            const Double_t ex_i = ex ? ex[i] : 0.;
+            const Double_t ey_i = ey ? ey[i] : 0.;
+            x_min = std::min(x_min, x[i] - ex_i);
+            x_max = std::max(x_max, x[i] + ex_i);
+            y_min = std::min(y_min, y[i] - ey_i);
+            y_max = std::max(y_max, y[i] + ey_i);
+          }
+        } else {
+          const TAxis* axis = obj->GetXaxis();
+          x_min = std::min(x_min, axis->GetXmin());
+          x_max = std::max(x_max, axis->GetXmax());
+          const Int_t n_bins = obj->GetNbinsX();
+          for (Int_t i = 1; i <= n_bins; ++i) {
+            const Double_t content = obj->GetBinContent(i);
+            const Double_t error = obj->GetBinError(i);
+            y_min = std::min(y_min, content - error);
+            y_max = std::max(y_max, content + error);
+          }
+        }
+      }
+      return {{x_min, x_max}, {y_min, y_max}};
+    }
+
+
+    template <typename TObjectRange>
+    void SetPaletteStyle(const TObjectRange& objs)
+    {
+      /*
+        Spreads the colors of the current palette over the objects and
+        cycles the marker styles, in one pass.
+      */
+
+      static constexpr Style_t marker_styles[] = {
+        kFullCircle, kFullSquare, kFullTriangleUp, kFullTriangleDown,
+        kOpenCircle, kOpenSquare, kOpenTriangleUp, kOpenDiamond
+      };
+      static constexpr Int_t n_marker_styles = std::size(marker_styles);
+
+      const Int_t n = std::distance(std::begin(objs), std::end(objs));
+      const Int_t n_colors = gStyle->GetNumberOfColors();
+      Int_t i = 0;
+      for (const auto& obj : objs) {
+        const Int_t i_color = (n > 1) ? i * (n_colors - 1) / (n - 1) : 0;
+        const Color_t color = gStyle->GetColorPalette(i_color);
+        obj->SetLineColor(color);
+        obj->SetMarkerColor(color);
+        obj->SetMarkerStyle(marker_styles[i % n_marker_styles]);
+        ++i;
+      }
+    }
+
+
+    template <typename TGraphRange>
+    std::unique_ptr<TMultiGraph> MakeMultiGraph(
+      TGraphRange&& graphs,
+      const Char_t* name,
+      const Char_t* title,
+      const Bool_t with_style = kTRUE
+    )
+    {
+      /*
+        Moves every graph of a range of unique_ptr into a new TMultiGraph,
+        which owns and deletes them. Axis titles are taken from the first
+        graph and the axis limits from GetLimits. As in graph::Create, a
+        null title is replaced by the y-axis title and a null name by the
+        title.
+      */
+
+      if (std::begin(graphs) == std::end(graphs)) {
+        return std::make_unique<TMultiGraph>(
+          name ? name : (title ? title : ""), title ? title : ""
+        );
+      }
+
+      if (with_style) {
+        SetPaletteStyle(graphs);
+      }
+      const auto [x_limit, y_limit] = GetLimits(graphs);
+
+      const auto& g_first = *std::begin(graphs);
+      const std::string title_main = (
+        title ? title : g_first->GetYaxis()->GetTitle()
+      );
+      auto mg = std::make_unique<TMultiGraph>(
+        name ? name : title_main.c_str(), title_main.c_str()
+      );
+      mg->SetTitle(
+        (
+          title_main + ";"
+          + g_first->GetXaxis()->GetTitle() + ";"
+          + g_first->GetYaxis()->GetTitle()
+        ).c_str()
+      );
+      for (auto& g : graphs) {
+        rss::Assert_if_is_inheritance_of_TGraph<
+          std::remove_pointer_t<decltype(g.get())>
+        >();
+        mg->Add(g.release());
+      }
+      graph::SetLimit(mg.get(), x_limit, y_limit);
+      return std::move(mg);
+    }
+
+
+    template <typename THistoRange>
+    std::unique_ptr<THStack> MakeStack(
+      const THistoRange& hists,
+      const Char_t* name,
+      const Char_t* title,
+      const Bool_t with_style = kTRUE
+    )
+    {
+      /*
+        THStack never deletes its histograms, so they stay owned by the
+        range, which must outlive the returned stack. Axis titles are taken
+        from the first histogram; null titles and names are handled as in
+        MakeMultiGraph.
+        The y-limits cover both the overlaid histograms (GetLimits) and the
+        cumulative sums drawn by the stack, so that the stack can be drawn
+        with and without "nostack". The x-range is that of the binning.
+      */
+
+      if (std::begin(hists) == std::end(hists)) {
+        return std::make_unique<THStack>(
+          name ? name : (title ? title : ""), title ? title : ""
+        );
+      }
+
+      if (with_style) {
+        SetPaletteStyle(hists);
+      }
+      auto [y_min, y_max] = GetLimits(hists).second;
+
+      const auto& h_first = *std::begin(hists);
+      const std::string title_main = (
+        title ? title : h_first->GetYaxis()->GetTitle()
+      );
+      auto hs = std::make_unique<THStack>(
+        name ? name : title_main.c_str(), title_main.c_str()
+      );
+      hs->SetTitle(
+        (
+          title_main + ";"
+          + h_first->GetXaxis()->GetTitle() + ";"
+          + h_first->GetYaxis()->GetTitle()
+        ).c_str()
+      );
+
+      const Int_t n_bins = h_first->GetNbinsX();
+      std::vector<Double_t> sums(n_bins + 1, 0.);
+      for (const auto& h : hists) {
+        rss::Assert_if_is_inheritance_of_TH1<
+          std::remove_pointer_t<decltype(&*h)>
+        >();
+        hs->Add(&*h);
+        if (h->GetNbinsX() != n_bins) {
+          continue;
+        }
+        for (Int_t i = 1; i <= n_bins; ++i) {
+          sums[i] += h->GetBinContent(i);
+          y_min = std::min(y_min, sums[i]);
+          y_max = std::max(y_max, sums[i]);
+        }
+      }
+      if (y_min < y_max) {
+        hs->SetMinimum(y_min);
+        hs->SetMaximum(y_max);
+      }
+      return std::move(hs);
     }
-  }
 
 
-  namespace draw
-  {
-    // inline void SetLogX(TCanvas* c)
-    // {
-    //   c->SetLogx();
-    // }
+    /*
+      Point-wise reductions over the contents of a TMultiGraph or THStack.
+      Graphs are linearly interpolated on a common x grid (points outside
+      the x range of a graph are skipped for that graph); histograms must
+      share the same binning. Results are returned as y with error ey:
+        Sum           : sum of y, quadratic sum of ey
+        Mean          : mean of y, standard error of the mean
+        Envelope      : center of [min, max], half width as error
+        QuantileBand  : center of [q, 1 - q] quantiles, half width as error
+    */
 
+    enum class ReduceMode
+    {
+      kSum,
+      kMean,
+      kQuantileBand
+    };
+
+
+    inline void ReduceColumns(
+      const std::vector<Double_t>& values,
+      const std::vector<Double_t>& errors,
+      const Int_t n_objs,
+      const Int_t n_cols,
+      const ReduceMode mode,
+      const Double_t fraction,
+      Double_t* y,
+      Double_t* ey
+    )
+    {
+      /*
+        values and errors are laid out column by column
+        (values[i_col * n_objs + i_obj]); NaN marks a missing value.
+      */
+
+      utils::ParallelFor(
+        0, n_cols,
+        [&] (const Long64_t col_begin, const Long64_t col_end, UInt_t)
+        {
+          std::vector<Double_t> scratch;
+          scratch.reserve(n_objs);
+          for (Long64_t i_col = col_begin; i_col < col_end; ++i_col) {
+            const Double_t* val = values.data() + i_col * n_objs;
+            const Double_t* err = errors.data() + i_col * n_objs;
+
+            Int_t n_valid = 0;
+            Double_t sum = 0.;
+            Double_t sum2 = 0.;
+            Double_t err_sum2 = 0.;
+            scratch.clear();
+            for (Int_t i = 0; i < n_objs; ++i) {
+              if (std::isnan(val[i])) {
+                continue;
+              }
+              ++n_valid;
+              sum += val[i];
+              sum2 += val[i] * val[i];
+              err_sum2 += err[i] * err[i];
+              scratch.push_back(val[i]);
+            }
+
+            if (n_valid == 0) {
+              y[i_col] = std::nan("");
+              ey[i_col] = std::nan("");
+            } else if (mode == ReduceMode::kSum) {
+              y[i_col] = sum;
+              ey[i_col] = std::sqrt(err_sum2);
+            } else if (mode == ReduceMode::kMean) {
+              const Double_t mean = sum / n_valid;
+              const Double_t var = (
+                (n_valid > 1)
+                ? (sum2 - n_valid * mean * mean) / (n_valid - 1)
+                : 0.
+              );
+              y[i_col] = mean;
+              ey[i_col] = std::sqrt(std::max(var, 0.) / n_valid);
+            } else {
+              std::sort(scratch.begin(), scratch.end());
+              auto Quantile = [&scratch] (const Double_t q)
+              {
+                const Double_t pos = q * (scratch.size() - 1);
+                const std::size_t i_low = static_cast<std::size_t>(pos);
+                const std::size_t i_high = std::min(
+                  i_low + 1, scratch.size() - 1
+                );
+                const Double_t w = pos - i_low;
+                return (1. - w) * scratch[i_low] + w * scratch[i_high];
+              };
+              const Double_t low = Quantile(fraction);
+              const Double_t high = Quantile(1. - fraction);
+              y[i_col] = (low + high) / 2.;
+              ey[i_col] = (high - low) / 2.;
+            }
+          }
+        }
+      );
+    }
 
-    // inline void SetLogY(TCanvas* c)
-    // {
-    //   c->SetLogy();
-    // }
 
+    inline std::unique_ptr<TGraphErrors> ReduceGraphs(
+      const TMultiGraph* mg,
+      const ReduceMode mode,
+      const Double_t fraction,
+      const std::vector<Double_t>& x_grid
+    )
+    {
+      TList* list = mg->GetListOfGraphs();
+      if (!list || list->GetEntries() == 0) {
+        throw std::invalid_argument(
+          std::string("No graphs in this TMultiGraph : ") + mg->GetName()
+        );
+      }
+      if (!(0. <= fraction && fraction < 0.5)) {
+        throw std::invalid_argument("fraction must be in [0, 0.5).");
+      }
 
-    inline void DrawLine(
-      TCanvas* c,
-      std::pair<Double_t, Double_t> point_1,
-      const std::pair<Double_t, Double_t> point_2,
-      const Color_t color = kBlack,
-      const Style_t style = kDashed,
-      const Width_t width = 0
+      const Int_t n_objs = list->GetEntries();
+      std::vector<const TGraph*> graphs(n_objs);
+      for (Int_t i = 0; i < n_objs; ++i) {
+        graphs[i] = static_cast<const TGraph*>(list->At(i));
+        if (!graph::IsSortedX(graphs[i])) {
+          throw std::invalid_argument(
+            std::string("x-values must be sorted (see SortX) : ")
+            + graphs[i]->GetName()
+          );
+        }
+      }
+
+      std::vector<Double_t> x_common = x_grid;
+      if (x_common.empty()) {
+        x_common.assign(
+          graphs[0]->GetX(), graphs[0]->GetX() + graphs[0]->GetN()
+        );
+      }
+      if (!std::is_sorted(x_common.begin(), x_common.end())) {
+        throw std::invalid_argument("x_grid must be sorted.");
+      }
+      const Int_t n_cols = x_common.size();
+
+      // Each graph is merged against the sorted grid in one linear sweep.
+      std::vector<Double_t> values(static_cast<std::size_t>(n_cols) * n_objs);
+      std::vector<Double_t> errors(values.size());
+      utils::ParallelFor(
+        0, n_objs,
+        [&] (const Long64_t obj_begin, const Long64_t obj_end, UInt_t)
+        {
+          for (Long64_t i_obj = obj_begin; i_obj < obj_end; ++i_obj) {
+            const TGraph* g = graphs[i_obj];
+            const Int_t n = g->GetN();
+            const Double_t* x = g->GetX();
+            const Double_t* y = g->GetY();
+            const Double_t* ey = g->GetEY();
+            Int_t i = 0;
+            for (Int_t i_col = 0; i_col < n_cols; ++i_col) {
+              const std::size_t index = (
+                static_cast<std::size_t>(i_col) * n_objs + i_obj
+              );
+              const Double_t xc = x_common[i_col];
+              while (i + 1 < n && x[i + 1] < xc) {
+                ++i;
+              }
+              if (n == 0 || xc < x[0] || x[n - 1] < xc) {
+                values[index] = std::nan("");
+                errors[index] = 0.;
+              } else if (xc == x[i]) {
+                values[index] = y[i];
+                errors[index] = ey ? ey[i] : 0.;
+              } else {
+                const Double_t w = (xc - x[i]) / (x[i + 1] - x[i]);
+                values[index] = (1. - w) * y[i] + w * y[i + 1];
+                errors[index] = ey ? (1. - w) * ey[i] + w * ey[i + 1] : 0.;
+              }
+            }
+          }
+        }
+      );
+
+      const TGraph* g_first = graphs[0];
+      auto g_reduced = std::move(graph::Create<TGraphErrors>(
+        n_cols,
+        mg->GetName(),
+        mg->GetTitle(),
+        g_first->GetXaxis()->GetTitle(),
+        g_first->GetYaxis()->GetTitle()
+      ));
+      std::copy(x_common.begin(), x_common.end(), g_reduced->GetX());
+      ReduceColumns(
+        values, errors, n_objs, n_cols, mode, fraction,
+        g_reduced->GetY(), g_reduced->GetEY()
+      );
+      g_reduced->SetBit(TGraph::kIsSortedX, kTRUE);
+      return std::move(g_reduced);
+    }
+
+
+    inline std::unique_ptr<TH1> ReduceHistos(
+      const THStack* hs,
+      const ReduceMode mode,
+      const Double_t fraction
     )
     {
-      auto l = new TLine(
-        point_1.first, point_1.second, point_2.first, point_2.second
+      TList* list = hs->GetHists();
+      if (!list || list->GetEntries() == 0) {
+        throw std::invalid_argument(
+          std::string("No histograms in this THStack : ") + hs->GetName()
+        );
+      }
+      if (!(0. <= fraction && fraction < 0.5)) {
+        throw std::invalid_argument("fraction must be in [0, 0.5).");
+      }
+
+      const Int_t n_objs = list->GetEntries();
+      std::vector<const TH1*> hists(n_objs);
+      for (Int_t i = 0; i < n_objs; ++i) {
+        hists[i] = static_cast<const TH1*>(list->At(i));
+      }
+
+      auto Is_same_axis = [] (const TAxis* axis, const TAxis* axis_first)
+      {
+        if (axis->GetNbins() != axis_first->GetNbins()) {
+          return kFALSE;
+        }
+        for (Int_t i = 1; i <= axis->GetNbins() + 1; ++i) {
+          if (axis->GetBinLowEdge(i) != axis_first->GetBinLowEdge(i)) {
+            return kFALSE;
+          }
+        }
+        return kTRUE;
+      };
+
+      // Cells are compared bin by bin, so every axis must match.
+      const TH1* h_first = hists[0];
+      const Int_t n_cols = h_first->GetNcells();
+      for (const TH1* h : hists) {
+        const Bool_t is_same = (
+          h->GetDimension() == h_first->GetDimension()
+          && h->GetNcells() == n_cols
+          && Is_same_axis(h->GetXaxis(), h_first->GetXaxis())
+          && Is_same_axis(h->GetYaxis(), h_first->GetYaxis())
+          && Is_same_axis(h->GetZaxis(), h_first->GetZaxis())
+        );
+        if (!is_same) {
+          throw std::invalid_argument(
+            std::string("Binning differs from the first histogram : ")
+            + h->GetName()
+          );
+        }
+      }
+
+      // All cells, including under/overflow, are reduced.
+      std::vector<Double_t> values(static_cast<std::size_t>(n_cols) * n_objs);
+      std::vector<Double_t> errors(values.size());
+      utils::ParallelFor(
+        0, n_objs,
+        [&] (const Long64_t obj_begin, const Long64_t obj_end, UInt_t)
+        {
+          for (Long64_t i_obj = obj_begin; i_obj < obj_end; ++i_obj) {
+            const TH1* h = hists[i_obj];
+            for (Int_t i_col = 0; i_col < n_cols; ++i_col) {
+              const std::size_t index = (
+                static_cast<std::size_t>(i_col) * n_objs + i_obj
+              );
+              values[index] = h->GetBinContent(i_col);
+              errors[index] = h->GetBinError(i_col);
+            }
+          }
+        }
       );
-      l->SetLineColor(color);
-      l->SetLineStyle(style);
-      if (width > 0) {
-        l->SetLineWidth(width);
+
+      std::vector<Double_t> y(n_cols);
+      std::vector<Double_t> ey(n_cols);
+      ReduceColumns(
+        values, errors, n_objs, n_cols, mode, fraction, y.data(), ey.data()
+      );
+
+      auto h_reduced = std::unique_ptr<TH1>(
+        static_cast<TH1*>(h_first->Clone(hs->GetName()))
+      );
+      h_reduced->SetDirectory(nullptr);
+      h_reduced->Reset();
+      h_reduced->SetTitle(hs->GetTitle());
+      h_reduced->GetXaxis()->SetTitle(h_first->GetXaxis()->GetTitle());
+      h_reduced->GetYaxis()->SetTitle(h_first->GetYaxis()->GetTitle());
+      h_reduced->Sumw2();
+      for (Int_t i_col = 0; i_col < n_cols; ++i_col) {
+        h_reduced->SetBinContent(i_col, y[i_col]);
+        h_reduced->SetBinError(i_col, ey[i_col]);
       }
-      c->cd();
-      l->Draw();
+      h_reduced->SetEntries(n_objs);
+      return std::move(h_reduced);
     }
 
 
-    inline void DrawLineVertical(
-      TCanvas* c,
-      const Double_t x,
-      const Color_t color = kBlack,
-      const Style_t style = kDashed,
-      const Width_t width = 0
+    inline std::unique_ptr<TGraphErrors> MakeGraphSum(
+      const TMultiGraph* mg, const std::vector<Double_t>& x_grid = {}
     )
     {
-      c->Update();
-      DrawLine(c, {x, c->GetUymin()}, {x, c->GetUymax()}, color, style, width);
+      return std::move(ReduceGraphs(mg, ReduceMode::kSum, 0., x_grid));
     }
 
 
-    inline void DrawLineHorizontal(
-      TCanvas* c,
-      const Double_t y,
-      const Color_t color = kBlack,
-      const Style_t style = kDashed,
-      const Width_t width = 0
+    inline std::unique_ptr<TGraphErrors> MakeGraphMean(
+      const TMultiGraph* mg, const std::vector<Double_t>& x_grid = {}
     )
     {
-      c->Update();
-      DrawLine(c, {c->GetUxmin(), y}, {c->GetUxmax(), y}, color, style, width);
+      return std::move(ReduceGraphs(mg, ReduceMode::kMean, 0., x_grid));
     }
 
 
-    template <typename TObjectLike, typename TDirectoryLike>
-    void FastSaveToRoot(
-      TObjectLike* obj,
-      TDirectoryLike* dir,
-      Option_t* /* = const Char_t* */ opt,
-      const Bool_t with_legend = kFALSE,
-      const std::tuple<
-        Double_t, Double_t, Double_t, Double_t
-      > legend_position = {0.3, 0.21, 0.3, 0.21}
+    inline std::unique_ptr<TGraphErrors> MakeGraphEnvelope(
+      const TMultiGraph* mg, const std::vector<Double_t>& x_grid = {}
     )
     {
-      rss::Assert_if_is_inheritance_of_TObject<TObjectLike>();
-      rss::Assert_if_is_inheritance_of_TDirectory<TDirectoryLike>();
-
-      auto c = std::make_unique<TCanvas>(obj->GetName(), obj->GetTitle());
-      c->cd();
-      obj->Draw(opt);
-      if (with_legend) {
-        const double& x_1 = std::get<0>(legend_position);
-        const double& y_1 = std::get<1>(legend_position);
-        const double& x_2 = std::get<2>(legend_position);
-        const double& y_2 = std::get<3>(legend_position);
-        c->BuildLegend(x_1, y_1, x_2, y_2);
-      }
-      dir->cd();
-      c->Write();
+      return std::move(
+        ReduceGraphs(mg, ReduceMode::kQuantileBand, 0., x_grid)
+      );
     }
 
 
-    template <typename TObjectLike>
-    void FastSaveToFile(
-      TObjectLike* obj,
-      const Char_t* filepath,
-      Option_t* /* = const Char_t* */ opt,
-      const Char_t stats_position = 'U',
-      const Bool_t with_legend = kFALSE,
-      const std::tuple<
-        Double_t, Double_t, Double_t, Double_t
-      > legend_position = {0.3, 0.21, 0.3, 0.21}
+    inline std::unique_ptr<TGraphErrors> MakeGraphQuantileBand(
+      const TMultiGraph* mg,
+      const Double_t fraction,
+      const std::vector<Double_t>& x_grid = {}
     )
     {
-      rss::Assert_if_is_inheritance_of_TObject<TObjectLike>();
+      return std::move(
+        ReduceGraphs(mg, ReduceMode::kQuantileBand, fraction, x_grid)
+      );
+    }
 
-      auto c = std::make_unique<TCanvas>(obj->GetName(), obj->GetTitle());
-      obj->Draw(opt);
-      if (with_legend) {
-        const double& x_1 = std::get<0>(legend_position);
-        const double& y_1 = std::get<1>(legend_position);
-        const double& x_2 = std::get<2>(legend_position);
-        const double& y_2 = std::get<3>(legend_position);
-        c->BuildLegend(x_1, y_1, x_2, y_2);
-      }
 
-      c->Update();
-      TPaveStats* stats = dynamic_cast<TPaveStats*>(
-        obj->GetListOfFunctions()->FindObject("stats")
-      );
-      if (stats) {
-        if (stats_position == 'U') {
-          stats->SetX1NDC(0.98);
-          stats->SetY1NDC(0.94);
-          stats->SetX2NDC(0.73);
-          stats->SetY2NDC(0.79);
-        } else if (stats_position == 'L') {
-          stats->SetX1NDC(0.98);
-          stats->SetY1NDC(0.34);
-          stats->SetX2NDC(0.73);
-          stats->SetY2NDC(0.19);
-        }
-      }
+    inline std::unique_ptr<TH1> MakeHistoSum(const THStack* hs)
+    {
+      return std::move(ReduceHistos(hs, ReduceMode::kSum, 0.));
+    }
 
-      c->SaveAs(filepath);
+
+    inline std::unique_ptr<TH1> MakeHistoMean(const THStack* hs)
+    {
+      return std::move(ReduceHistos(hs, ReduceMode::kMean, 0.));
     }
 
 
-    template <typename TObjectLike>
-    void FastSaveToFile(
-      TObjectLike* obj,
-      const std::filesystem::path& filepath,
-      Option_t* /* = const Char_t* */ opt,
-      const Char_t stats_position = 'U',
-      const Bool_t with_legend = kFALSE,
-      const std::tuple<
-        Double_t, Double_t, Double_t, Double_t
-      > legend_position = {0.3, 0.21, 0.3, 0.21}
+    inline std::unique_ptr<TH1> MakeHistoEnvelope(const THStack* hs)
+    {
+      return std::move(ReduceHistos(hs, ReduceMode::kQuantileBand, 0.));
+    }
+
+
+    inline std::unique_ptr<TH1> MakeHistoQuantileBand(
+      const THStack* hs, const Double_t fraction
     )
     {
-      FastSaveToFile(
-        obj, filepath.c_str(), opt, stats_position, with_legend, legend_position
-      );
+      return std::move(ReduceHistos(hs, ReduceMode::kQuantileBand, fraction));
     }
   }
 
 
-  namespace mul
+  namespace file
   {
-    inline void SetByFirstObject(const std::unique_ptr<TMultiGraph>& mg)
+    class FileMerger
     {
-      if (mg->GetListOfGraphs()->GetEntries() == 0) {
-        throw std::invalid_argument(
-          std::string("No graphs in this TMultiGraph : ") + mg->GetName()
+      /*
+        FileMerger merges files of similar directory layouts, e.g. the
+        outputs of many jobs: histograms are added and graphs concatenated
+        in input order. The layout of the output is the union of the
+        layouts (TH1 and TGraph objects in any subdirectory) of the inputs,
+        so objects found in some inputs only are kept as well. Each thread
+        reads a contiguous range of the inputs into one partial result, so
+        memory is bounded by n_threads partial results whatever the number
+        of inputs; the partial results are then merged pairwise in
+        parallel. The output lists the inputs it contains, so that an
+        incremental merge only reads the new ones.
+      */
+
+    private:
+      // Keyed by (directory path, key name), so written in alphabetical
+      // order of the directory paths and then of the names.
+      using Objects = std::map<
+        std::pair<std::string, std::string>, std::unique_ptr<TObject>
+      >;
+
+      static constexpr const Char_t* inputs_name_ = "rs_merged_inputs";
+
+      UInt_t n_threads_;
+
+
+    public:
+      FileMerger(const UInt_t n_threads = 0)
+      : n_threads_(utils::GetNThreads(n_threads))
+      {
+      }
+
+      ~FileMerger() = default;
+
+      FileMerger(const FileMerger& rh) = default;
+
+      FileMerger(FileMerger&& rh) = default;
+
+      FileMerger& operator=(const FileMerger& rh) = default;
+
+      FileMerger& operator=(FileMerger&& rh) = default;
+
+
+      std::size_t Merge(
+        const std::vector<std::filesystem::path>& inputs,
+        const std::filesystem::path& output,
+        const Bool_t incremental = kFALSE
+      ) const
+      {
+        /*
+          Merges inputs into output, which is written by Create.
+          With incremental, an existing output is merged with the inputs it
+          does not list yet and then replaced. Returns the number of inputs
+          read.
+        */
+
+        std::unique_ptr<TFile> previous;
+        std::vector<std::string> merged_inputs;
+        if (incremental && std::filesystem::exists(output)) {
+          previous = std::move(Open(output));
+          std::vector<std::string>* list_raw = nullptr;
+          previous->GetObject(inputs_name_, list_raw);
+          std::unique_ptr<std::vector<std::string>> list(list_raw);
+          if (list) {
+            merged_inputs = *list;
+          }
+        }
+
+        std::vector<std::string> new_inputs;
+        for (const auto& input : inputs) {
+          const std::string path = (
+            std::filesystem::absolute(input).lexically_normal().string()
+          );
+          if (
+            std::find(merged_inputs.begin(), merged_inputs.end(), path)
+            == merged_inputs.end()
+          ) {
+            new_inputs.push_back(path);
+          }
+        }
+        if (new_inputs.empty()) {
+          return 0;
+        }
+
+        Objects merged;
+        if (previous) {
+          ReadInto(previous.get(), merged, output.string());
+          previous.reset();
+        }
+
+        const UInt_t n_used = std::min<std::size_t>(
+          n_threads_, new_inputs.size()
+        );
+        std::vector<Objects> partials(n_used);
+        if (n_used > 1) {
+          ROOT::EnableThreadSafety();
+        }
+        utils::ParallelFor(
+          0, new_inputs.size(),
+          [&] (const Long64_t begin, const Long64_t end, UInt_t i_thread)
+          {
+            for (Long64_t i = begin; i < end; ++i) {
+              auto input = std::move(Open(new_inputs[i].c_str()));
+              ReadInto(input.get(), partials[i_thread], new_inputs[i]);
+            }
+          },
+          n_used
+        );
+
+        // Adjacent partial results are merged, which keeps the input order.
+        for (UInt_t stride = 1; stride < n_used; stride *= 2) {
+          const Long64_t n_pairs = (n_used + 2 * stride - 1) / (2 * stride);
+          utils::ParallelFor(
+            0, n_pairs,
+            [&] (const Long64_t begin, const Long64_t end, UInt_t)
+            {
+              for (Long64_t pair = begin; pair < end; ++pair) {
+                const UInt_t i = pair * 2 * stride;
+                if (i + stride < n_used) {
+                  AddAll(partials[i], partials[i + stride]);
+                }
+              }
+            },
+            n_threads_
+          );
+        }
+        AddAll(merged, partials[0]);
+        merged_inputs.insert(
+          merged_inputs.end(), new_inputs.begin(), new_inputs.end()
         );
+
+        // The output may be one of the inputs of an incremental merge.
+        const std::filesystem::path tmp_path = output.string() + ".tmp";
+        {
+          auto file = std::move(Create(tmp_path));
+          for (const auto& [path, obj] : merged) {
+            TDirectory* dir = file.get();
+            if (!path.first.empty()) {
+              dir = file->mkdir(path.first.c_str(), "", kTRUE);
+            }
+            Save(obj.get(), dir);
+          }
+          file->WriteObject(&merged_inputs, inputs_name_);
+          file->Close();
+        }
+        std::filesystem::rename(tmp_path, output);
+        return new_inputs.size();
       }
 
-      auto* g = static_cast<TGraph*>(mg->GetListOfGraphs()->At(0));
-      mg->GetXaxis()->SetTitle(g->GetXaxis()->GetTitle());
-      mg->GetYaxis()->SetTitle(g->GetYaxis()->GetTitle());
-    }
 
+    private:
+      static void ReadInto(
+        TDirectory* dir,
+        Objects& merged,
+        const std::string& input,
+        const std::string& dir_path = ""
+      )
+      {
+        std::vector<std::string> names;
+        TIter key_iter(dir->GetListOfKeys());
+        while (auto* key = static_cast<TKey*>(key_iter())) {
+          const std::string name = key->GetName();
+          // Only the highest cycle of each name.
+          if (std::find(names.begin(), names.end(), name) != names.end()) {
+            continue;
+          }
+          names.push_back(name);
+
+          if (IsKeyOf<TDirectory>(key)) {
+            ReadInto(
+              dir->GetDirectory(name.c_str()),
+              merged,
+              input,
+              dir_path.empty() ? name : dir_path + "/" + name
+            );
+          } else if (IsKeyOf<TH1>(key) || IsKeyOf<TGraph>(key)) {
+            std::unique_ptr<TObject> obj(key->ReadObj());
+            // Save writes objects under their own names.
+            if (auto* named = dynamic_cast<TNamed*>(obj.get())) {
+              named->SetName(name.c_str());
+            }
+            if (auto* h = dynamic_cast<TH1*>(obj.get())) {
+              h->SetDirectory(nullptr);
+            }
+            Add(merged[{dir_path, name}], std::move(obj), input);
+          }
+        }
+      }
 
-    inline void SetByFirstObject(const std::unique_ptr<THStack>& hs)
-    {
-      if (hs->GetHists()->GetEntries() == 0) {
-        throw std::invalid_argument(
-          std::string("No histograms in this THStack : ") + hs->GetName()
+      static void Add(
+        std::unique_ptr<TObject>& merged,
+        std::unique_ptr<TObject>&& obj,
+        const std::string& input = ""
+      )
+      {
+        /*
+          input names the file obj was read from in error messages; it is
+          empty when partial results are merged.
+        */
+
+
+        if (!obj) {
+          return;
+        }
+        if (!merged) {
+          merged = std::move(obj);
+          return;
+        }
+
+        const std::string source = (
+          std::string(merged->GetName()) + (input.empty() ? "" : " of " + input)
         );
+        const Bool_t is_histo = merged->InheritsFrom(TH1::Class());
+        if (is_histo != obj->InheritsFrom(TH1::Class())) {
+          throw std::invalid_argument(
+            std::string("Unable to merge ") + obj->ClassName()
+            + " into " + merged->ClassName() + " : " + source
+          );
+        }
+        if (is_histo) {
+          const Bool_t is_added = static_cast<TH1*>(merged.get())->Add(
+            static_cast<const TH1*>(obj.get())
+          );
+          if (!is_added) {
+            throw std::invalid_argument(
+              "Unable to add inconsistent histograms : " + source
+            );
+          }
+        } else if (
+          merged->IsA() == TGraphErrors::Class()
+          && obj->InheritsFrom(TGraphErrors::Class())
+        ) {
+          graph::PushGraph(
+            static_cast<const TGraphErrors*>(obj.get()),
+            static_cast<TGraphErrors*>(merged.get())
+          );
+        } else if (merged->IsA() == TGraph::Class()) {
+          graph::PushGraph(
+            static_cast<const TGraph*>(obj.get()),
+            static_cast<TGraph*>(merged.get())
+          );
+        } else {
+          TList list;
+          list.Add(obj.get());
+          static_cast<TGraph*>(merged.get())->Merge(&list);
+        }
       }
 
-      auto* h = static_cast<TH1*>(hs->GetHists()->At(0));
-      hs->GetXaxis()->SetTitle(h->GetXaxis()->GetTitle());
-      hs->GetYaxis()->SetTitle(h->GetYaxis()->GetTitle());
-    }
+      static void AddAll(Objects& merged, Objects& objs)
+      {
+        for (auto& [path, obj] : objs) {
+          Add(merged[path], std::move(obj));
+        }
+      }
+    };
   }
 
 
@@ -0,0 +1,636 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Rtypes.h"
+#include "TAxis.h"
+#include "TFile.h"
+#include "TGraph.h"
+#include "TGraphErrors.h"
+#include "TH1.h"
+#include "TH1D.h"
+#include "TROOT.h"
+#include "TRandom3.h"
+#include "TVirtualFFT.h"
+
+#include "RootSupport.h"
+
+#ifndef ROOTSUPPORT_VERSION
+#define ROOTSUPPORT_VERSION "unknown"
+#endif
+
+
+
+/*
+  RootSupport_bench generates synthetic ROOT files in a work directory and
+  measures the hot paths of RootSupport. Each benchmark reports the
+  throughput, the latency percentiles of one iteration and the heap
+  allocations per iteration, as JSON and optionally as CSV, so that results
+  of two versions can be compared.
+
+  usage : RootSupport_bench [--json path] [--csv path] [--work-dir dir]
+                            [--scale factor]
+*/
+
+
+
+namespace
+{
+  std::atomic<Long64_t> n_allocs{0};
+  std::atomic<Long64_t> n_alloc_bytes{0};
+}
+
+
+// Counts every plain (non-aligned) allocation of the process.
+void* operator new(std::size_t size)
+{
+  n_allocs.fetch_add(1, std::memory_order_relaxed);
+  n_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+
+void operator delete[](void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+
+void operator delete(void* ptr, std::size_t /* size */) noexcept
+{
+  std::free(ptr);
+}
+
+
+void operator delete[](void* ptr, std::size_t /* size */) noexcept
+{
+  std::free(ptr);
+}
+
+
+
+namespace bench
+{
+  struct Result
+  {
+    std::string name;
+    Long64_t n_iterations;
+    Long64_t items_per_iteration;
+    Double_t throughput;
+    Double_t mean;
+    Double_t p50;
+    Double_t p90;
+    Double_t p99;
+    Double_t max;
+    Double_t allocs_per_iteration;
+    Double_t alloc_bytes_per_iteration;
+  };
+
+
+  Result Measure(
+    const std::string& name,
+    const Long64_t n_iterations,
+    const Long64_t items_per_iteration,
+    const std::function<void(Long64_t)>& body,
+    const Long64_t n_warmup = 1
+  )
+  {
+    /*
+      Calls body(i) n_warmup times, then n_iterations times while timing
+      each call. Allocations are counted over the timed calls.
+    */
+
+    for (Long64_t i = 0; i < std::min(n_warmup, n_iterations); ++i) {
+      body(i);
+    }
+
+    std::vector<Double_t> times(n_iterations);
+    const Long64_t allocs_begin = n_allocs.load();
+    const Long64_t bytes_begin = n_alloc_bytes.load();
+    for (Long64_t i = 0; i < n_iterations; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      body(i);
+      times[i] = std::chrono::duration<Double_t>(
+        std::chrono::steady_clock::now() - start
+      ).count();
+    }
+    const Long64_t allocs = n_allocs.load() - allocs_begin;
+    const Long64_t bytes = n_alloc_bytes.load() - bytes_begin;
+
+    Double_t total = 0.;
+    for (const Double_t t : times) {
+      total += t;
+    }
+    std::sort(times.begin(), times.end());
+    auto Percentile = [&times] (const Double_t p)
+    {
+      const std::size_t i = static_cast<std::size_t>(p * (times.size() - 1));
+      return times[i];
+    };
+
+    Result result;
+    result.name = name;
+    result.n_iterations = n_iterations;
+    result.items_per_iteration = items_per_iteration;
+    result.throughput = (
+      (total > 0.) ? n_iterations * items_per_iteration / total : 0.
+    );
+    result.mean = total / n_iterations;
+    result.p50 = Percentile(0.50);
+    result.p90 = Percentile(0.90);
+    result.p99 = Percentile(0.99);
+    result.max = times.back();
+    result.allocs_per_iteration = static_cast<Double_t>(allocs) / n_iterations;
+    result.alloc_bytes_per_iteration = (
+      static_cast<Double_t>(bytes) / n_iterations
+    );
+
+    std::cout
+      << std::left << std::setw(32) << name
+      << std::right << std::setprecision(4)
+      << " p50 [s] : " << std::setw(10) << result.p50
+      << " p99 [s] : " << std::setw(10) << result.p99
+      << " items/s : " << std::setw(10) << result.throughput
+      << " allocs/it : " << result.allocs_per_iteration
+      << std::endl;
+    return result;
+  }
+
+
+  void WriteJson(
+    const std::string& filepath, const std::vector<Result>& results
+  )
+  {
+    std::ofstream ofs(filepath);
+    if (!ofs) {
+      throw std::runtime_error("failed to open this file : " + filepath);
+    }
+
+    ofs << std::setprecision(9);
+    ofs << "{\n";
+    ofs << "  \"rootsupport_version\": \"" << ROOTSUPPORT_VERSION << "\",\n";
+    ofs << "  \"root_version\": \"" << gROOT->GetVersion() << "\",\n";
+    ofs << "  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      const Result& r = results[i];
+      ofs
+        << "    {\"name\": \"" << r.name << "\""
+        << ", \"n_iterations\": " << r.n_iterations
+        << ", \"items_per_iteration\": " << r.items_per_iteration
+        << ", \"throughput\": " << r.throughput
+        << ", \"mean\": " << r.mean
+        << ", \"p50\": " << r.p50
+        << ", \"p90\": " << r.p90
+        << ", \"p99\": " << r.p99
+        << ", \"max\": " << r.max
+        << ", \"allocs_per_iteration\": " << r.allocs_per_iteration
+        << ", \"alloc_bytes_per_iteration\": " << r.alloc_bytes_per_iteration
+        << "}" << ((i + 1 < results.size()) ? "," : "") << "\n";
+    }
+    ofs << "  ]\n";
+    ofs << "}\n";
+  }
+
+
+  void WriteCsv(
+    const std::string& filepath, const std::vector<Result>& results
+  )
+  {
+    std::ofstream ofs(filepath);
+    if (!ofs) {
+      throw std::runtime_error("failed to open this file : " + filepath);
+    }
+
+    ofs << std::setprecision(9);
+    ofs
+      << "rootsupport_version,root_version,name,n_iterations,"
+      << "items_per_iteration,throughput,mean,p50,p90,p99,max,"
+      << "allocs_per_iteration,alloc_bytes_per_iteration\n";
+    for (const Result& r : results) {
+      ofs
+        << ROOTSUPPORT_VERSION << ","
+        << gROOT->GetVersion() << ","
+        << r.name << ","
+        << r.n_iterations << ","
+        << r.items_per_iteration << ","
+        << r.throughput << ","
+        << r.mean << ","
+        << r.p50 << ","
+        << r.p90 << ","
+        << r.p99 << ","
+        << r.max << ","
+        << r.allocs_per_iteration << ","
+        << r.alloc_bytes_per_iteration << "\n";
+    }
+  }
+
+
+  std::unique_ptr<TGraphErrors> MakeSyntheticGraph(
+    const Int_t n, const Char_t* name, TRandom3& rng
+  )
+  {
+    auto g = rs::graph::Create<TGraphErrors>(n, name, name, "x", "y");
+    for (Int_t i = 0; i < n; ++i) {
+      g->SetPoint(i, i, rng.Gaus(0., 1.));
+      g->SetPointError(i, 0.5, 1.);
+    }
+    return g;
+  }
+
+
+  void MakeTreeFile(const std::filesystem::path& filepath, const Long64_t n)
+  {
+    auto file = rs::file::Create(filepath);
+    file->cd();
+    {
+      rs::TreeHelper helper({"x/D", "y/D", "z/D", "n/I", "flag/B"});
+      TRandom3 rng(1);
+      for (Long64_t entry = 0; entry < n; ++entry) {
+        std::get<Double_t>(helper.get("x/D")) = rng.Gaus(0., 1.);
+        std::get<Double_t>(helper.get("y/D")) = rng.Uniform(0., 1.);
+        std::get<Double_t>(helper.get("z/D")) = rng.Exp(1.);
+        std::get<Int_t>(helper.get("n/I")) = rng.Poisson(5.);
+        std::get<Bool_t>(helper.get("flag/B")) = (rng.Rndm() < 0.5);
+        helper.Fill();
+      }
+      file->cd();
+      helper.Write();
+    }
+    file->Close();
+  }
+
+
+  void MakeObjectFile(const std::filesystem::path& filepath, const Int_t n)
+  {
+    auto file = rs::file::Create(filepath);
+    TRandom3 rng(2);
+    for (Int_t i = 0; i < n; ++i) {
+      const std::string name = "h_" + std::to_string(i);
+      TH1D h(name.c_str(), name.c_str(), 100, -5., 5.);
+      h.FillRandom("gaus", 1000);
+      rs::file::Save(&h, file.get());
+
+      auto g = MakeSyntheticGraph(100, ("g_" + std::to_string(i)).c_str(), rng);
+      rs::file::Save(g.get(), file.get());
+    }
+    file->Close();
+  }
+
+
+  void BenchTree(
+    const std::filesystem::path& work_dir,
+    const Long64_t scale,
+    std::vector<Result>& results
+  )
+  {
+    const Long64_t n_entries = 100000 * scale;
+    const auto filepath = work_dir / "bench_tree.root";
+    MakeTreeFile(filepath, n_entries);
+
+    auto file = rs::file::Open(filepath);
+    {
+      rs::TreeHelper helper(rs::file::GetObj<TTree>("tree", file.get()));
+      results.push_back(Measure(
+        "tree_helper_get_entry",
+        n_entries,
+        1,
+        [&helper] (const Long64_t entry) { helper.GetEntry(entry); },
+        0
+      ));
+      results.push_back(Measure(
+        "tree_helper_loop",
+        10,
+        n_entries,
+        [&helper, n_entries] (Long64_t)
+        {
+          for (Long64_t entry = 0; entry < n_entries; ++entry) {
+            helper.GetEntry(entry);
+          }
+        }
+      ));
+    }
+  }
+
+
+  void BenchFile(
+    const std::filesystem::path& work_dir,
+    const Long64_t scale,
+    std::vector<Result>& results
+  )
+  {
+    const Int_t n_objects = 200 * scale;
+    const auto filepath = work_dir / "bench_objects.root";
+    MakeObjectFile(filepath, n_objects);
+
+    auto file = rs::file::Open(filepath);
+    results.push_back(Measure(
+      "file_get_obj_list_th1",
+      20,
+      n_objects,
+      [&file] (Long64_t) { rs::file::GetObjList<TH1>(file.get()); }
+    ));
+    results.push_back(Measure(
+      "file_get_obj_list_tgraph",
+      20,
+      n_objects,
+      [&file] (Long64_t) { rs::file::GetObjList<TGraph>(file.get()); }
+    ));
+  }
+
+
+  void CheckDecimated(
+    const TGraph* g, const TGraph* g_decimated, const Int_t n_columns
+  )
+  {
+    /*
+      Throws unless g_decimated has the x-axis range of g and the same
+      minimum and maximum y as g in each of the n_columns columns of the
+      displayed x range, i.e. unless both are drawn the same.
+    */
+
+    const TAxis* axis = g->GetXaxis();
+    const TAxis* axis_decimated = g_decimated->GetXaxis();
+    if (
+      axis->GetXmin() != axis_decimated->GetXmin()
+      || axis->GetXmax() != axis_decimated->GetXmax()
+      || axis->GetFirst() != axis_decimated->GetFirst()
+      || axis->GetLast() != axis_decimated->GetLast()
+    ) {
+      throw std::runtime_error(
+        "graph_make_decimated : the x-axis range is not kept."
+      );
+    }
+
+    const Double_t x_low = axis->GetBinLowEdge(axis->GetFirst());
+    const Double_t x_up = axis->GetBinUpEdge(axis->GetLast());
+    const Double_t scale = n_columns / (x_up - x_low);
+    auto Extrema = [x_low, x_up, scale, n_columns] (const TGraph* graph)
+    {
+      std::vector<Double_t> y_min(
+        n_columns, std::numeric_limits<Double_t>::infinity()
+      );
+      std::vector<Double_t> y_max(
+        n_columns, -std::numeric_limits<Double_t>::infinity()
+      );
+      for (Int_t i = 0; i < graph->GetN(); ++i) {
+        const Double_t x = graph->GetX()[i];
+        if (x < x_low || x > x_up) {
+          continue;
+        }
+        const Int_t column = std::min(
+          static_cast<Int_t>((x - x_low) * scale), n_columns - 1
+        );
+        y_min[column] = std::min(y_min[column], graph->GetY()[i]);
+        y_max[column] = std::max(y_max[column], graph->GetY()[i]);
+      }
+      return std::make_pair(y_min, y_max);
+    };
+    if (Extrema(g) != Extrema(g_decimated)) {
+      throw std::runtime_error(
+        "graph_make_decimated : the displayed points are not kept."
+      );
+    }
+  }
+
+
+  void BenchGraph(const Long64_t scale, std::vector<Result>& results)
+  {
+    TRandom3 rng(3);
+
+    const Int_t n_pushed = 1000;
+    const Long64_t n_pushes = 200 * scale;
+    auto g_pushed = MakeSyntheticGraph(n_pushed, "g_pushed", rng);
+    auto g = rs::graph::Create<TGraphErrors>(0, "g", "g", "x", "y");
+    results.push_back(Measure(
+      "graph_push_graph",
+      n_pushes,
+      n_pushed,
+      [&g_pushed, &g] (Long64_t)
+      {
+        rs::graph::PushGraph(g_pushed.get(), g.get());
+      }
+    ));
+
+    const Int_t n_points = 1000000 * scale;
+    auto g_large = MakeSyntheticGraph(n_points, "g_large", rng);
+    results.push_back(Measure(
+      "graph_make_coarse_grained",
+      20,
+      n_points,
+      [&g_large] (Long64_t)
+      {
+        rs::graph::MakeGraphCoarseGrained(g_large.get(), 10);
+      }
+    ));
+
+    // A graph with limits and a zoom, as drawn with level of detail.
+    const Int_t n_columns = 1000;
+    g_large->GetXaxis()->SetLimits(0.1 * n_points, 0.9 * n_points);
+    g_large->GetXaxis()->SetRangeUser(0.2 * n_points, 0.6 * n_points);
+    CheckDecimated(
+      g_large.get(),
+      rs::graph::MakeGraphDecimated(g_large.get(), n_columns).get(),
+      n_columns
+    );
+    results.push_back(Measure(
+      "graph_make_decimated",
+      20,
+      n_points,
+      [&g_large, n_columns] (Long64_t)
+      {
+        rs::graph::MakeGraphDecimated(g_large.get(), n_columns);
+      }
+    ));
+  }
+
+
+  void BenchFFT(const Long64_t scale, std::vector<Result>& results)
+  {
+    Int_t n = 65536 * scale;
+    if (!TVirtualFFT::FFT(1, &n, "R2C ES")) {
+      std::cout << "math_fft is skipped : no FFT plugin." << std::endl;
+      return;
+    }
+
+    TRandom3 rng(4);
+    std::vector<Double_t> y(n);
+    for (auto& val : y) {
+      val = rng.Gaus(0., 1.);
+    }
+    results.push_back(Measure(
+      "math_fft",
+      50,
+      n,
+      [&y] (Long64_t) { rs::math::FFT(y); }
+    ));
+  }
+
+
+  void BenchDetached(
+    const std::filesystem::path& work_dir,
+    const Long64_t scale,
+    std::vector<Result>& results
+  )
+  {
+    /*
+      Booking n_histos histograms in a file and closing it, with the
+      histograms registered with the file or owned by unique_ptr only.
+    */
+
+    const Int_t n_histos = 10000 * scale;
+    const auto filepath = work_dir / "bench_detached.root";
+
+    TH1::AddDirectory(kTRUE);
+    results.push_back(Measure(
+      "th1_book_and_close_attached",
+      5,
+      n_histos,
+      [&filepath, n_histos] (Long64_t)
+      {
+        auto file = rs::file::Create(filepath);
+        for (Int_t i = 0; i < n_histos; ++i) {
+          const std::string name = "h_" + std::to_string(i);
+          // Owned and deleted by the file.
+          new TH1D(name.c_str(), name.c_str(), 100, 0., 1.);
+        }
+        file->Close();
+      }
+    ));
+
+    results.push_back(Measure(
+      "th1_book_and_close_detached",
+      5,
+      n_histos,
+      [&filepath, n_histos] (Long64_t)
+      {
+        rs::utils::DetachedScope detached;
+        auto file = rs::file::Create(filepath);
+        std::vector<std::unique_ptr<TH1D>> histos;
+        histos.reserve(n_histos);
+        for (Int_t i = 0; i < n_histos; ++i) {
+          const std::string name = "h_" + std::to_string(i);
+          histos.push_back(
+            std::make_unique<TH1D>(name.c_str(), name.c_str(), 100, 0., 1.)
+          );
+        }
+        histos.clear();
+        file->Close();
+      }
+    ));
+    TH1::AddDirectory(kFALSE);
+  }
+
+
+  void BenchDraw(
+    const std::filesystem::path& work_dir,
+    const Long64_t scale,
+    std::vector<Result>& results
+  )
+  {
+    const Long64_t n_plots = 20 * scale;
+    TH1D h("h_draw", "h_draw", 100, -5., 5.);
+    h.FillRandom("gaus", 10000);
+    const auto filepath = work_dir / "bench_draw.png";
+
+    results.push_back(Measure(
+      "draw_fast_save_to_file",
+      n_plots,
+      1,
+      [&h, &filepath] (Long64_t)
+      {
+        rs::draw::FastSaveToFile(&h, filepath, "");
+      }
+    ));
+
+    rs::draw::CanvasPool pool;
+    results.push_back(Measure(
+      "draw_canvas_pool_fast_save_to_file",
+      n_plots,
+      1,
+      [&h, &filepath, &pool] (Long64_t)
+      {
+        pool.FastSaveToFile(&h, filepath, "");
+      }
+    ));
+  }
+}
+
+
+
+int main(int argc, char** argv)
+{
+  std::string json_path = "RootSupport_bench.json";
+  std::string csv_path = "";
+  std::filesystem::path work_dir = std::filesystem::temp_directory_path();
+  Long64_t scale = 1;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "missing value for " << arg << std::endl;
+      return 1;
+    }
+    if (arg == "--json") {
+      json_path = argv[++i];
+    } else if (arg == "--csv") {
+      csv_path = argv[++i];
+    } else if (arg == "--work-dir") {
+      work_dir = argv[++i];
+    } else if (arg == "--scale") {
+      scale = std::max(std::atoll(argv[++i]), 1ll);
+    } else {
+      std::cerr << "unknown option : " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  gROOT->SetBatch(kTRUE);
+  TH1::AddDirectory(kFALSE);
+  std::filesystem::create_directories(work_dir);
+
+  std::vector<bench::Result> results;
+  try {
+    bench::BenchTree(work_dir, scale, results);
+    bench::BenchFile(work_dir, scale, results);
+    bench::BenchGraph(scale, results);
+    bench::BenchFFT(scale, results);
+    bench::BenchDetached(work_dir, scale, results);
+    bench::BenchDraw(work_dir, scale, results);
+
+    bench::WriteJson(json_path, results);
+    if (!csv_path.empty()) {
+      bench::WriteCsv(csv_path, results);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,627 @@
+#ifndef ROOTCOLUMNAR_H
+#define ROOTCOLUMNAR_H
+
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Rtypes.h"
+#include "TBranch.h"
+#include "TDirectory.h"
+#include "TFile.h"
+#include "TLeaf.h"
+#include "TROOT.h"
+#include "TTree.h"
+
+#include "RootParallel.h"
+#include "RootTree.h"
+
+
+
+namespace rs
+{
+  /*
+    Columnar layout written by ExportColumns and read by ImportColumns :
+
+      <dir>/schema.txt   "entries <n>", "byte_order <little|big>", then one
+                         "<name> <B|I|D>" line per column (B : the "/B"
+                         branches of TreeHelper, whose leaves are Char_t)
+      <dir>/<name>.bin   the n raw values of the column (Bool_t : 1 byte,
+                         Int_t : 4 bytes, Double_t : 8 bytes, native order)
+
+    Each .bin file is a plain array that can be memory-mapped as is,
+    e.g. numpy.memmap(path, dtype="<f8").
+  */
+
+  struct ColumnSpec
+  {
+    std::string name;
+    Char_t type;  // 'B', 'I' or 'D', as in the TreeHelper branch names.
+  };
+
+
+  namespace columnar
+  {
+    inline std::size_t GetTypeSize(const Char_t type)
+    {
+      switch (type) {
+        case 'B' : return sizeof(Bool_t);
+        case 'I' : return sizeof(Int_t);
+        case 'D' : return sizeof(Double_t);
+        default : throw std::invalid_argument(
+          std::string("unknown column type : ") + type
+        );
+      }
+    }
+
+
+    inline const Char_t* GetByteOrder()
+    {
+      const UShort_t probe = 1;
+      const Bool_t is_little = (*reinterpret_cast<const UChar_t*>(&probe) == 1);
+      return is_little ? "little" : "big";
+    }
+
+
+    inline std::vector<ColumnSpec> GetColumnSpecs(
+      const TreeHelper& helper, const std::vector<std::string>& names
+    )
+    {
+      /*
+        Bool_t, Int_t and Double_t branches of the tree, in tree order, or
+        the given branches in the given order. TreeHelper writes Bool_t
+        branches as "name/B", i.e. with a Char_t leaf, so both Bool_t and
+        Char_t leaves are taken as 'B' columns.
+      */
+
+      std::vector<ColumnSpec> specs;
+      auto Add_spec = [&specs] (TBranch* branch)
+      {
+        const std::string bname = branch->GetName();
+        const std::string type_name = (
+          branch->GetLeaf(bname.c_str())->GetTypeName()
+        );
+        if (type_name == "Bool_t" || type_name == "Char_t") {
+          specs.push_back({bname, 'B'});
+        } else if (type_name == "Int_t") {
+          specs.push_back({bname, 'I'});
+        } else if (type_name == "Double_t") {
+          specs.push_back({bname, 'D'});
+        } else {
+          return kFALSE;
+        }
+        return kTRUE;
+      };
+
+      TTree* tree = helper.GetTree();
+      if (names.empty()) {
+        TObjArray* branches = tree->GetListOfBranches();
+        for (Int_t i = 0; i < branches->GetEntries(); ++i) {
+          Add_spec(static_cast<TBranch*>(branches->At(i)));
+        }
+        return specs;
+      }
+
+      for (const auto& name : names) {
+        TBranch* branch = tree->GetBranch(name.c_str());
+        if (!branch) {
+          throw std::invalid_argument("No such branch : " + name);
+        }
+        if (!Add_spec(branch)) {
+          throw std::invalid_argument("Unsupported branch type : " + name);
+        }
+      }
+      return specs;
+    }
+
+
+    class ColumnReader
+    {
+      /*
+        Reads only the given columns of a tree, entry by entry. On the tree
+        of a TreeHelper, the values of the helper are used as they are;
+        on any other tree, and for branches the helper does not hold, the
+        reader binds its own values.
+      */
+
+    private:
+      TTree* tree_;
+      std::vector<TBranch*> branches_;
+      std::vector<const void*> values_;
+      std::unique_ptr<TreeHelper::LeafType[]> own_values_;
+
+
+    public:
+      ColumnReader(TreeHelper& helper, const std::vector<ColumnSpec>& specs)
+      : tree_(helper.GetTree()),
+        own_values_(std::make_unique<TreeHelper::LeafType[]>(specs.size()))
+      {
+        for (std::size_t i = 0; i < specs.size(); ++i) {
+          const TreeHelper::LeafType* val = nullptr;
+          try {
+            val = &helper.get(specs[i].name + "/" + specs[i].type);
+          } catch (const std::out_of_range&) {
+            BindOwnValue(i, specs[i]);
+            continue;
+          }
+          branches_.push_back(tree_->GetBranch(specs[i].name.c_str()));
+          values_.push_back(std::visit(
+            [] (const auto& v) { return static_cast<const void*>(&v); }, *val
+          ));
+        }
+      }
+
+      ColumnReader(TTree* tree, const std::vector<ColumnSpec>& specs)
+      : tree_(tree),
+        own_values_(std::make_unique<TreeHelper::LeafType[]>(specs.size()))
+      {
+        for (std::size_t i = 0; i < specs.size(); ++i) {
+          BindOwnValue(i, specs[i]);
+        }
+      }
+
+      void SetCacheRange(const Long64_t first, const Long64_t last)
+      {
+        if (!tree_->GetCurrentFile()) {
+          return;
+        }
+        tree_->SetCacheSize();
+        for (TBranch* branch : branches_) {
+          tree_->AddBranchToCache(branch);
+        }
+        tree_->StopCacheLearningPhase();
+        tree_->SetCacheEntryRange(first, last);
+      }
+
+      Bool_t Read(const Long64_t entry)
+      {
+        const Long64_t local_entry = tree_->LoadTree(entry);
+        if (local_entry < 0) {
+          return kFALSE;
+        }
+        for (TBranch* branch : branches_) {
+          branch->GetEntry(local_entry);
+        }
+        return kTRUE;
+      }
+
+      const void* GetValue(const std::size_t i) const
+      {
+        return values_[i];
+      }
+
+
+    private:
+      void BindOwnValue(const std::size_t i, const ColumnSpec& spec)
+      {
+        void* ptr = nullptr;
+        switch (spec.type) {
+          case 'B' : ptr = &own_values_[i].emplace<Bool_t>(); break;
+          case 'I' : ptr = &own_values_[i].emplace<Int_t>(); break;
+          default : ptr = &own_values_[i].emplace<Double_t>(); break;
+        }
+        tree_->SetBranchAddress(spec.name.c_str(), ptr);
+        branches_.push_back(tree_->GetBranch(spec.name.c_str()));
+        values_.push_back(ptr);
+      }
+    };
+
+
+    template <typename Function>
+    void ReadInParallel(
+      TreeHelper& helper,
+      const std::vector<ColumnSpec>& specs,
+      const UInt_t n_threads,
+      Function&& func
+    )
+    {
+      /*
+        Calls func(reader, first, last, i_thread) on contiguous ranges of
+        clusters. Each thread reopens the file of the tree; trees that are
+        not read from a read-only file (utils::IsReopenable) are read by one
+        thread through the helper.
+      */
+
+      TTree* tree = helper.GetTree();
+      const Long64_t n_entries = helper.GetEntries();
+      const auto clusters = utils::GetClusterRanges(tree);
+      const UInt_t n_used = (
+        (utils::IsReopenable(tree) && clusters.size() > 1)
+        ? std::min<UInt_t>(utils::GetNThreads(n_threads), clusters.size())
+        : 1
+      );
+
+      if (n_used == 1) {
+        ColumnReader reader(helper, specs);
+        reader.SetCacheRange(0, n_entries);
+        func(reader, Long64_t(0), n_entries, 0u);
+        return;
+      }
+
+      ROOT::EnableThreadSafety();
+      const std::string filepath = tree->GetCurrentFile()->GetName();
+      const std::string treepath = utils::GetPathInFile(tree);
+      utils::ParallelFor(
+        0, clusters.size(),
+        [&] (const Long64_t c_begin, const Long64_t c_end, UInt_t i_thread)
+        {
+          auto [file_thread, tree_thread] = utils::ReopenTree(
+            filepath, treepath, n_entries
+          );
+          ColumnReader reader(tree_thread, specs);
+          const Long64_t first = clusters[c_begin].first;
+          const Long64_t last = clusters[c_end - 1].second;
+          reader.SetCacheRange(first, last);
+          func(reader, first, last, i_thread);
+        },
+        n_used
+      );
+    }
+
+
+    class TemporaryFiles
+    {
+      /*
+        Removes the given files on destruction, also when an exception is
+        thrown.
+      */
+
+    private:
+      std::vector<std::filesystem::path> paths_;
+
+
+    public:
+      explicit TemporaryFiles(std::vector<std::filesystem::path> paths)
+      : paths_(std::move(paths))
+      {
+      }
+
+      ~TemporaryFiles()
+      {
+        for (const auto& path : paths_) {
+          std::error_code error;
+          std::filesystem::remove(path, error);
+        }
+      }
+
+      TemporaryFiles(const TemporaryFiles& rh) = delete;
+
+      TemporaryFiles(TemporaryFiles&& rh) = delete;
+
+      TemporaryFiles& operator=(const TemporaryFiles& rh) = delete;
+
+      TemporaryFiles& operator=(TemporaryFiles&& rh) = delete;
+
+      const std::filesystem::path& operator[](const std::size_t i) const
+      {
+        return paths_[i];
+      }
+    };
+
+
+    inline void AppendCsvValue(
+      std::string& line, const void* value, const Char_t type
+    )
+    {
+      Char_t buffer[32];
+      std::to_chars_result result;
+      switch (type) {
+        case 'B' : {
+          line.push_back(*static_cast<const Bool_t*>(value) ? '1' : '0');
+          return;
+        }
+        case 'I' : {
+          result = std::to_chars(
+            buffer, buffer + sizeof(buffer), *static_cast<const Int_t*>(value)
+          );
+          break;
+        }
+        default : {
+          result = std::to_chars(
+            buffer, buffer + sizeof(buffer),
+            *static_cast<const Double_t*>(value)
+          );
+          break;
+        }
+      }
+      line.append(buffer, result.ptr);
+    }
+  }
+
+
+  inline void ExportColumns(
+    TreeHelper& helper,
+    const std::filesystem::path& dirpath,
+    const std::vector<std::string>& names = {},
+    const UInt_t n_threads = 0,
+    const std::size_t block_size = 1 << 16
+  )
+  {
+    /*
+      Writes the selected branches (all Bool_t, Int_t and Double_t
+      branches by default) into dirpath in the columnar layout above.
+      The column files are sized up front, so that each thread writes its
+      own entry range in blocks of block_size values.
+    */
+
+    const auto specs = columnar::GetColumnSpecs(helper, names);
+    const Long64_t n_entries = helper.GetEntries();
+    std::filesystem::create_directories(dirpath);
+
+    {
+      std::ofstream schema(dirpath / "schema.txt");
+      if (!schema) {
+        throw std::runtime_error(
+          "failed to open this file : " + (dirpath / "schema.txt").string()
+        );
+      }
+      schema << "entries " << n_entries << "\n";
+      schema << "byte_order " << columnar::GetByteOrder() << "\n";
+      for (const auto& spec : specs) {
+        schema << spec.name << " " << spec.type << "\n";
+      }
+    }
+
+    std::vector<std::filesystem::path> column_paths;
+    for (const auto& spec : specs) {
+      column_paths.push_back(dirpath / (spec.name + ".bin"));
+      std::ofstream(column_paths.back(), std::ios::binary | std::ios::trunc);
+      std::filesystem::resize_file(
+        column_paths.back(), n_entries * columnar::GetTypeSize(spec.type)
+      );
+    }
+
+    columnar::ReadInParallel(
+      helper, specs, n_threads,
+      [&] (
+        columnar::ColumnReader& reader,
+        const Long64_t first,
+        const Long64_t last,
+        UInt_t /* i_thread */
+      )
+      {
+        const std::size_t n_columns = specs.size();
+        std::vector<std::fstream> outputs(n_columns);
+        std::vector<std::vector<Char_t>> buffers(n_columns);
+        std::vector<std::size_t> sizes(n_columns);
+        for (std::size_t i = 0; i < n_columns; ++i) {
+          sizes[i] = columnar::GetTypeSize(specs[i].type);
+          outputs[i].open(
+            column_paths[i], std::ios::binary | std::ios::in | std::ios::out
+          );
+          if (!outputs[i]) {
+            throw std::runtime_error(
+              "failed to open this file : " + column_paths[i].string()
+            );
+          }
+          outputs[i].seekp(first * sizes[i]);
+          buffers[i].reserve(block_size * sizes[i]);
+        }
+
+        auto Flush = [&] ()
+        {
+          for (std::size_t i = 0; i < n_columns; ++i) {
+            outputs[i].write(buffers[i].data(), buffers[i].size());
+            buffers[i].clear();
+          }
+        };
+
+        for (Long64_t entry = first; entry < last; ++entry) {
+          if (!reader.Read(entry)) {
+            throw std::runtime_error(
+              "failed to read entry " + std::to_string(entry)
+            );
+          }
+          for (std::size_t i = 0; i < n_columns; ++i) {
+            const auto* value = static_cast<const Char_t*>(reader.GetValue(i));
+            buffers[i].insert(buffers[i].end(), value, value + sizes[i]);
+          }
+          if ((entry - first + 1) % block_size == 0) {
+            Flush();
+          }
+        }
+        Flush();
+      }
+    );
+  }
+
+
+  inline void ExportCsv(
+    TreeHelper& helper,
+    const std::filesystem::path& filepath,
+    const std::vector<std::string>& names = {},
+    const UInt_t n_threads = 0,
+    const Char_t delimiter = ',',
+    const std::size_t buffer_bytes = 1 << 20
+  )
+  {
+    /*
+      Writes the selected branches as CSV with a header line. Each thread
+      formats its entry range with std::to_chars into "<filepath>.part<i>",
+      flushing every buffer_bytes; the parts are then concatenated in order.
+      Double_t values are written in their shortest round-trip form.
+    */
+
+    const auto specs = columnar::GetColumnSpecs(helper, names);
+    const UInt_t n_parts = utils::GetNThreads(n_threads);
+    std::vector<std::filesystem::path> part_paths;
+    for (UInt_t i = 0; i < n_parts; ++i) {
+      part_paths.push_back(filepath.string() + ".part" + std::to_string(i));
+    }
+    const columnar::TemporaryFiles parts(std::move(part_paths));
+
+    // One flag per part; not a std::vector<bool>, which threads may not
+    // write concurrently.
+    std::vector<UChar_t> is_written(n_parts, 0);
+    columnar::ReadInParallel(
+      helper, specs, n_threads,
+      [&] (
+        columnar::ColumnReader& reader,
+        const Long64_t first,
+        const Long64_t last,
+        const UInt_t i_thread
+      )
+      {
+        std::ofstream ofs(parts[i_thread], std::ios::binary);
+        if (!ofs) {
+          throw std::runtime_error(
+            "failed to open this file : " + parts[i_thread].string()
+          );
+        }
+        is_written[i_thread] = 1;
+
+        std::string buffer;
+        buffer.reserve(buffer_bytes + 1024);
+        for (Long64_t entry = first; entry < last; ++entry) {
+          if (!reader.Read(entry)) {
+            throw std::runtime_error(
+              "failed to read entry " + std::to_string(entry)
+            );
+          }
+          for (std::size_t i = 0; i < specs.size(); ++i) {
+            if (i > 0) {
+              buffer.push_back(delimiter);
+            }
+            columnar::AppendCsvValue(buffer, reader.GetValue(i), specs[i].type);
+          }
+          buffer.push_back('\n');
+          if (buffer.size() >= buffer_bytes) {
+            ofs.write(buffer.data(), buffer.size());
+            buffer.clear();
+          }
+        }
+        ofs.write(buffer.data(), buffer.size());
+      }
+    );
+
+    std::ofstream ofs(filepath, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+      throw std::runtime_error(
+        "failed to open this file : " + filepath.string()
+      );
+    }
+    for (std::size_t i = 0; i < specs.size(); ++i) {
+      if (i > 0) {
+        ofs << delimiter;
+      }
+      ofs << specs[i].name;
+    }
+    ofs << "\n";
+    for (UInt_t i = 0; i < n_parts; ++i) {
+      if (!is_written[i]) {
+        continue;
+      }
+      std::ifstream part(parts[i], std::ios::binary);
+      if (part.peek() != std::ifstream::traits_type::eof()) {
+        ofs << part.rdbuf();
+      }
+    }
+  }
+
+
+  inline TreeHelper ImportColumns(
+    const std::filesystem::path& dirpath,
+    TDirectory* dir = nullptr,
+    const std::size_t block_size = 1 << 16
+  )
+  {
+    /*
+      Builds a TreeHelper tree from the columnar layout above, in dir
+      (gDirectory by default). The column files are read in blocks of
+      block_size values and the rows are filled through TTree::Fill, so
+      that the tree gets its usual AutoFlush clusters.
+    */
+
+    std::ifstream schema(dirpath / "schema.txt");
+    if (!schema) {
+      throw std::invalid_argument(
+        "No such file : " + (dirpath / "schema.txt").string()
+      );
+    }
+
+    std::string key;
+    Long64_t n_entries = 0;
+    std::string byte_order;
+    schema >> key >> n_entries;
+    if (key != "entries") {
+      throw std::runtime_error("Invalid schema : " + dirpath.string());
+    }
+    schema >> key >> byte_order;
+    if (key != "byte_order" || byte_order != columnar::GetByteOrder()) {
+      throw std::runtime_error("Unsupported byte order : " + byte_order);
+    }
+
+    std::vector<ColumnSpec> specs;
+    std::vector<std::string> branch_names;
+    ColumnSpec spec;
+    while (schema >> spec.name >> spec.type) {
+      columnar::GetTypeSize(spec.type);
+      specs.push_back(spec);
+      branch_names.push_back(spec.name + "/" + spec.type);
+    }
+
+    std::unique_ptr<TDirectory::TContext> context;
+    if (dir) {
+      context = std::make_unique<TDirectory::TContext>(dir);
+    }
+    TreeHelper helper(branch_names);
+
+    const std::size_t n_columns = specs.size();
+    std::vector<std::ifstream> inputs(n_columns);
+    std::vector<std::size_t> sizes(n_columns);
+    std::vector<void*> addresses(n_columns);
+    std::vector<std::vector<Char_t>> buffers(n_columns);
+    for (std::size_t i = 0; i < n_columns; ++i) {
+      sizes[i] = columnar::GetTypeSize(specs[i].type);
+      const auto column_path = dirpath / (specs[i].name + ".bin");
+      if (
+        !std::filesystem::exists(column_path)
+        || std::filesystem::file_size(column_path) != n_entries * sizes[i]
+      ) {
+        throw std::runtime_error(
+          "Column file does not match the schema : " + column_path.string()
+        );
+      }
+      inputs[i].open(column_path, std::ios::binary);
+      if (!inputs[i]) {
+        throw std::runtime_error(
+          "failed to open this file : " + column_path.string()
+        );
+      }
+      addresses[i] = std::visit(
+        [] (auto& v) { return static_cast<void*>(&v); },
+        helper.get(branch_names[i])
+      );
+      buffers[i].resize(block_size * sizes[i]);
+    }
+
+    for (Long64_t first = 0; first < n_entries; first += block_size) {
+      const Long64_t n = std::min<Long64_t>(block_size, n_entries - first);
+      for (std::size_t i = 0; i < n_columns; ++i) {
+        if (!inputs[i].read(buffers[i].data(), n * sizes[i])) {
+          throw std::runtime_error(
+            "failed to read column : " + specs[i].name
+          );
+        }
+      }
+      for (Long64_t j = 0; j < n; ++j) {
+        for (std::size_t i = 0; i < n_columns; ++i) {
+          std::memcpy(addresses[i], buffers[i].data() + j * sizes[i], sizes[i]);
+        }
+        helper.Fill();
+      }
+    }
+    return helper;
+  }
+}
+
+
+
+#endif // ROOTCOLUMNAR_H
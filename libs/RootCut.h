@@ -0,0 +1,730 @@
+#ifndef ROOTCUT_H
+#define ROOTCUT_H
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Rtypes.h"
+#include "TBranch.h"
+#include "TTree.h"
+
+#include "RootTree.h"
+
+
+
+namespace rs
+{
+  namespace cut
+  {
+    /*
+      namespace cut provides typed expressions over the values of a
+      TreeHelper, e.g.
+        auto pt_cut = col<Double_t>("pt") > 20 && col<Int_t>("n") == 2;
+        pt_cut.Bind(helper);
+        helper.GetEntry(i);
+        if (pt_cut.Eval()) { ... }
+      Bind resolves every column to a pointer into the TreeHelper once, so
+      Eval is straight-line code without variant visits. && and ||
+      short-circuit as usual.
+      BindBatch and EvalAt do the same over the arrays of a ColumnBatch,
+      which is how Selection::Select evaluates cuts.
+    */
+
+    template <typename T>
+    struct LeafSuffix;
+
+    template <>
+    struct LeafSuffix<Bool_t>
+    {
+      static constexpr Char_t value = 'B';
+    };
+
+    template <>
+    struct LeafSuffix<Int_t>
+    {
+      static constexpr Char_t value = 'I';
+    };
+
+    template <>
+    struct LeafSuffix<Double_t>
+    {
+      static constexpr Char_t value = 'D';
+    };
+
+
+    class ColumnBatch
+    {
+      /*
+        Values of some branches of a TreeHelper for a batch of consecutive
+        entries, one contiguous array per branch. Load reads one branch at
+        a time for the given positions of the batch, so that the reads of a
+        branch stay within its current baskets; positions that are not
+        loaded keep stale values.
+      */
+
+    private:
+      struct Buffer
+      {
+        TBranch* branch;
+        const void* value;
+        std::size_t size;
+        std::vector<UChar_t> data;
+        Bool_t is_loaded = kFALSE;
+      };
+
+      TTree* tree_;
+      std::map<std::string, Buffer> buffers_;
+      Long64_t begin_ = 0;
+
+
+    public:
+      explicit ColumnBatch(TTree* tree)
+      : tree_(tree)
+      {
+      }
+
+      const std::vector<UChar_t>& Add(
+        const std::string& name, const void* value, const std::size_t size
+      )
+      {
+        auto it = buffers_.find(name);
+        if (it == buffers_.end()) {
+          TBranch* branch = tree_->GetBranch(name.c_str());
+          if (!branch) {
+            throw std::invalid_argument("No such branch : " + name);
+          }
+          it = buffers_.emplace(name, Buffer{branch, value, size, {}}).first;
+        }
+        return it->second.data;
+      }
+
+      void Begin(const Long64_t begin, const Long64_t end)
+      {
+        begin_ = begin;
+        for (auto& [name, buffer] : buffers_) {
+          buffer.data.resize((end - begin) * buffer.size);
+          buffer.is_loaded = kFALSE;
+        }
+      }
+
+      void Load(const std::string& name, const std::vector<Int_t>& positions)
+      {
+        Buffer& buffer = buffers_.at(name);
+        if (buffer.is_loaded) {
+          return;
+        }
+        UChar_t* data = buffer.data.data();
+        for (const Int_t i : positions) {
+          buffer.branch->GetEntry(begin_ + i);
+          std::memcpy(data + i * buffer.size, buffer.value, buffer.size);
+        }
+        buffer.is_loaded = kTRUE;
+      }
+    };
+
+
+    struct Expr
+    {
+    };
+
+    template <typename E>
+    constexpr Bool_t is_expr_v = std::is_base_of_v<Expr, std::decay_t<E>>;
+
+
+    template <typename T>
+    class Column : public Expr
+    {
+    private:
+      std::string name_;
+      const T* ptr_ = nullptr;
+      const std::vector<UChar_t>* data_ = nullptr;
+
+
+    public:
+      explicit Column(const std::string& name)
+      : name_(name)
+      {
+      }
+
+      void Bind(TreeHelper& helper)
+      {
+        const std::string key = name_ + "/" + LeafSuffix<T>::value;
+        try {
+          ptr_ = std::get_if<T>(&helper.get(key));
+        } catch (const std::out_of_range&) {
+          throw std::invalid_argument("No such branch : " + key);
+        }
+      }
+
+      void BindBatch(ColumnBatch& batch)
+      {
+        data_ = &batch.Add(name_, ptr_, sizeof(T));
+      }
+
+      void CollectBranches(std::vector<std::string>& names) const
+      {
+        names.push_back(name_);
+      }
+
+      T Eval() const
+      {
+        return *ptr_;
+      }
+
+      T EvalAt(const std::size_t i) const
+      {
+        T value;
+        std::memcpy(&value, data_->data() + i * sizeof(T), sizeof(T));
+        return value;
+      }
+    };
+
+
+    template <typename T>
+    class Constant : public Expr
+    {
+    private:
+      T value_;
+
+
+    public:
+      explicit Constant(const T value)
+      : value_(value)
+      {
+      }
+
+      void Bind(TreeHelper&)
+      {
+      }
+
+      void BindBatch(ColumnBatch&)
+      {
+      }
+
+      void CollectBranches(std::vector<std::string>&) const
+      {
+      }
+
+      T Eval() const
+      {
+        return value_;
+      }
+
+      T EvalAt(const std::size_t) const
+      {
+        return value_;
+      }
+    };
+
+
+    template <typename Op, typename L, typename R>
+    class Binary : public Expr
+    {
+    private:
+      L l_;
+      R r_;
+
+
+    public:
+      Binary(L l, R r)
+      : l_(std::move(l)), r_(std::move(r))
+      {
+      }
+
+      void Bind(TreeHelper& helper)
+      {
+        l_.Bind(helper);
+        r_.Bind(helper);
+      }
+
+      void BindBatch(ColumnBatch& batch)
+      {
+        l_.BindBatch(batch);
+        r_.BindBatch(batch);
+      }
+
+      void CollectBranches(std::vector<std::string>& names) const
+      {
+        l_.CollectBranches(names);
+        r_.CollectBranches(names);
+      }
+
+      auto Eval() const
+      {
+        return Op()(l_.Eval(), r_.Eval());
+      }
+
+      auto EvalAt(const std::size_t i) const
+      {
+        return Op()(l_.EvalAt(i), r_.EvalAt(i));
+      }
+    };
+
+
+    template <typename L, typename R>
+    class And : public Expr
+    {
+    private:
+      L l_;
+      R r_;
+
+
+    public:
+      And(L l, R r)
+      : l_(std::move(l)), r_(std::move(r))
+      {
+      }
+
+      void Bind(TreeHelper& helper)
+      {
+        l_.Bind(helper);
+        r_.Bind(helper);
+      }
+
+      void BindBatch(ColumnBatch& batch)
+      {
+        l_.BindBatch(batch);
+        r_.BindBatch(batch);
+      }
+
+      void CollectBranches(std::vector<std::string>& names) const
+      {
+        l_.CollectBranches(names);
+        r_.CollectBranches(names);
+      }
+
+      Bool_t Eval() const
+      {
+        return l_.Eval() && r_.Eval();
+      }
+
+      Bool_t EvalAt(const std::size_t i) const
+      {
+        return l_.EvalAt(i) && r_.EvalAt(i);
+      }
+    };
+
+
+    template <typename L, typename R>
+    class Or : public Expr
+    {
+    private:
+      L l_;
+      R r_;
+
+
+    public:
+      Or(L l, R r)
+      : l_(std::move(l)), r_(std::move(r))
+      {
+      }
+
+      void Bind(TreeHelper& helper)
+      {
+        l_.Bind(helper);
+        r_.Bind(helper);
+      }
+
+      void BindBatch(ColumnBatch& batch)
+      {
+        l_.BindBatch(batch);
+        r_.BindBatch(batch);
+      }
+
+      void CollectBranches(std::vector<std::string>& names) const
+      {
+        l_.CollectBranches(names);
+        r_.CollectBranches(names);
+      }
+
+      Bool_t Eval() const
+      {
+        return l_.Eval() || r_.Eval();
+      }
+
+      Bool_t EvalAt(const std::size_t i) const
+      {
+        return l_.EvalAt(i) || r_.EvalAt(i);
+      }
+    };
+
+
+    template <typename E>
+    class Not : public Expr
+    {
+    private:
+      E e_;
+
+
+    public:
+      explicit Not(E e)
+      : e_(std::move(e))
+      {
+      }
+
+      void Bind(TreeHelper& helper)
+      {
+        e_.Bind(helper);
+      }
+
+      void BindBatch(ColumnBatch& batch)
+      {
+        e_.BindBatch(batch);
+      }
+
+      void CollectBranches(std::vector<std::string>& names) const
+      {
+        e_.CollectBranches(names);
+      }
+
+      Bool_t Eval() const
+      {
+        return !e_.Eval();
+      }
+
+      Bool_t EvalAt(const std::size_t i) const
+      {
+        return !e_.EvalAt(i);
+      }
+    };
+
+
+    template <typename T>
+    Column<T> col(const std::string& name)
+    {
+      return Column<T>(name);
+    }
+
+
+    template <typename T>
+    auto AsExpr(T&& value)
+    {
+      if constexpr (is_expr_v<T>) {
+        return std::decay_t<T>(std::forward<T>(value));
+      } else {
+        static_assert(
+          std::is_arithmetic_v<std::decay_t<T>>,
+          "Operands must be cut expressions or arithmetic values."
+        );
+        return Constant<std::decay_t<T>>(value);
+      }
+    }
+
+
+    template <typename Op, typename L, typename R>
+    auto MakeBinary(L&& l, R&& r)
+    {
+      using LExpr = decltype(AsExpr(std::forward<L>(l)));
+      using RExpr = decltype(AsExpr(std::forward<R>(r)));
+      return Binary<Op, LExpr, RExpr>(
+        AsExpr(std::forward<L>(l)), AsExpr(std::forward<R>(r))
+      );
+    }
+
+
+    template <typename L, typename R>
+    using EnableIfExpr = std::enable_if_t<is_expr_v<L> || is_expr_v<R>>;
+
+
+    template <typename L, typename R, typename = EnableIfExpr<L, R>>
+    auto operator<(L&& l, R&& r)
+    {
+      return MakeBinary<std::less<>>(std::forward<L>(l), std::forward<R>(r));
+    }
+
+    template <typename L, typename R, typename = EnableIfExpr<L, R>>
+    auto operator<=(L&& l, R&& r)
+    {
+      return MakeBinary<std::less_equal<>>(
+        std::forward<L>(l), std::forward<R>(r)
+      );
+    }
+
+    template <typename L, typename R, typename = EnableIfExpr<L, R>>
+    auto operator>(L&& l, R&& r)
+    {
+      return MakeBinary<std::greater<>>(
+        std::forward<L>(l), std::forward<R>(r)
+      );
+    }
+
+    template <typename L, typename R, typename = EnableIfExpr<L, R>>
+    auto operator>=(L&& l, R&& r)
+    {
+      return MakeBinary<std::greater_equal<>>(
+        std::forward<L>(l), std::forward<R>(r)
+      );
+    }
+
+    template <typename L, typename R, typename = EnableIfExpr<L, R>>
+    auto operator==(L&& l, R&& r)
+    {
+      return MakeBinary<std::equal_to<>>(
+        std::forward<L>(l), std::forward<R>(r)
+      );
+    }
+
+    template <typename L, typename R, typename = EnableIfExpr<L, R>>
+    auto operator!=(L&& l, R&& r)
+    {
+      return MakeBinary<std::not_equal_to<>>(
+        std::forward<L>(l), std::forward<R>(r)
+      );
+    }
+
+    template <typename L, typename R, typename = EnableIfExpr<L, R>>
+    auto operator+(L&& l, R&& r)
+    {
+      return MakeBinary<std::plus<>>(std::forward<L>(l), std::forward<R>(r));
+    }
+
+    template <typename L, typename R, typename = EnableIfExpr<L, R>>
+    auto operator-(L&& l, R&& r)
+    {
+      return MakeBinary<std::minus<>>(std::forward<L>(l), std::forward<R>(r));
+    }
+
+    template <typename L, typename R, typename = EnableIfExpr<L, R>>
+    auto operator*(L&& l, R&& r)
+    {
+      return MakeBinary<std::multiplies<>>(
+        std::forward<L>(l), std::forward<R>(r)
+      );
+    }
+
+    template <typename L, typename R, typename = EnableIfExpr<L, R>>
+    auto operator/(L&& l, R&& r)
+    {
+      return MakeBinary<std::divides<>>(
+        std::forward<L>(l), std::forward<R>(r)
+      );
+    }
+
+    template <typename L, typename R, typename = EnableIfExpr<L, R>>
+    auto operator&&(L&& l, R&& r)
+    {
+      using LExpr = decltype(AsExpr(std::forward<L>(l)));
+      using RExpr = decltype(AsExpr(std::forward<R>(r)));
+      return And<LExpr, RExpr>(
+        AsExpr(std::forward<L>(l)), AsExpr(std::forward<R>(r))
+      );
+    }
+
+    template <typename L, typename R, typename = EnableIfExpr<L, R>>
+    auto operator||(L&& l, R&& r)
+    {
+      using LExpr = decltype(AsExpr(std::forward<L>(l)));
+      using RExpr = decltype(AsExpr(std::forward<R>(r)));
+      return Or<LExpr, RExpr>(
+        AsExpr(std::forward<L>(l)), AsExpr(std::forward<R>(r))
+      );
+    }
+
+    template <typename E, typename = std::enable_if_t<is_expr_v<E>>>
+    auto operator!(E&& e)
+    {
+      return Not<std::decay_t<E>>(std::forward<E>(e));
+    }
+
+
+    class Selection
+    {
+      /*
+        Selection is a conjunction of named cuts. The cuts are reordered
+        from time to time so that the one rejecting the largest fraction of
+        the entries it sees is evaluated first.
+        Pass evaluates the current entry of the TreeHelper. Select runs
+        over a range of entries in batches that do not cross clusters, cut
+        by cut: the branches of a cut are read into the arrays of a
+        ColumnBatch, one branch at a time and only for the entries still
+        selected, and the cut is then evaluated over these arrays.
+      */
+
+    private:
+      struct Cut
+      {
+        std::string name;
+        std::function<Bool_t()> eval;
+        std::function<Bool_t(std::size_t)> eval_at;
+        std::function<void(TreeHelper&, ColumnBatch&)> bind;
+        std::vector<std::string> branch_names;
+        Long64_t n_evaluated = 0;
+        Long64_t n_rejected = 0;
+      };
+
+      std::vector<Cut> cuts_;
+      std::unique_ptr<ColumnBatch> batch_;
+      TTree* tree_ = nullptr;
+      Long64_t reorder_interval_;
+      Long64_t n_calls_ = 0;
+
+
+    public:
+      Selection(const Long64_t reorder_interval = 10000)
+      : reorder_interval_(reorder_interval)
+      {
+      }
+
+      ~Selection() = default;
+
+      Selection(const Selection& rh) = delete;
+
+      Selection(Selection&& rh) = default;
+
+      Selection& operator=(const Selection& rh) = delete;
+
+      Selection& operator=(Selection&& rh) = default;
+
+
+      template <typename E>
+      void Add(const std::string& name, E expr)
+      {
+        static_assert(is_expr_v<E>, "Cuts must be cut expressions.");
+
+        auto e = std::make_shared<E>(std::move(expr));
+        Cut c;
+        c.name = name;
+        c.eval = [e] ()
+        {
+          return static_cast<Bool_t>(e->Eval());
+        };
+        c.eval_at = [e] (const std::size_t i)
+        {
+          return static_cast<Bool_t>(e->EvalAt(i));
+        };
+        c.bind = [e] (TreeHelper& helper, ColumnBatch& batch)
+        {
+          e->Bind(helper);
+          e->BindBatch(batch);
+        };
+        e->CollectBranches(c.branch_names);
+        cuts_.push_back(std::move(c));
+      }
+
+      void Bind(TreeHelper& helper)
+      {
+        tree_ = helper.GetTree();
+        batch_ = std::make_unique<ColumnBatch>(tree_);
+        for (auto& c : cuts_) {
+          c.bind(helper, *batch_);
+        }
+      }
+
+      Bool_t Pass()
+      {
+        Bool_t is_passed = kTRUE;
+        for (auto& c : cuts_) {
+          ++c.n_evaluated;
+          if (!c.eval()) {
+            ++c.n_rejected;
+            is_passed = kFALSE;
+            break;
+          }
+        }
+        ++n_calls_;
+        if (reorder_interval_ > 0 && n_calls_ % reorder_interval_ == 0) {
+          Reorder();
+        }
+        return is_passed;
+      }
+
+      std::vector<Long64_t> Select(
+        const Long64_t first,
+        const Long64_t last,
+        const Long64_t batch_size = 1 << 16
+      )
+      {
+        if (!batch_) {
+          throw std::logic_error("Selection must be bound before Select.");
+        }
+
+        std::vector<std::pair<Long64_t, Long64_t>> batches;
+        for (const auto& [c_first, c_last] : utils::GetClusterRanges(tree_)) {
+          const Long64_t c_end = std::min(last, c_last);
+          for (
+            Long64_t begin = std::max(first, c_first);
+            begin < c_end;
+            begin += batch_size
+          ) {
+            batches.push_back({begin, std::min(c_end, begin + batch_size)});
+          }
+        }
+
+        std::vector<Long64_t> selected;
+        std::vector<Int_t> positions;
+        std::vector<Int_t> passed;
+        for (const auto& [begin, end] : batches) {
+          batch_->Begin(begin, end);
+          positions.resize(end - begin);
+          for (Int_t i = 0; i < end - begin; ++i) {
+            positions[i] = i;
+          }
+
+          for (auto& c : cuts_) {
+            for (const auto& bname : c.branch_names) {
+              batch_->Load(bname, positions);
+            }
+            passed.clear();
+            for (const Int_t i : positions) {
+              if (c.eval_at(i)) {
+                passed.push_back(i);
+              }
+            }
+            c.n_evaluated += positions.size();
+            c.n_rejected += positions.size() - passed.size();
+            std::swap(positions, passed);
+          }
+          for (const Int_t i : positions) {
+            selected.push_back(begin + i);
+          }
+          Reorder();
+        }
+        return selected;
+      }
+
+      void Reorder()
+      {
+        auto Rejection = [] (const Cut& c)
+        {
+          return (c.n_evaluated > 0)
+            ? static_cast<Double_t>(c.n_rejected) / c.n_evaluated
+            : 0.;
+        };
+        std::stable_sort(
+          cuts_.begin(), cuts_.end(),
+          [&Rejection] (const Cut& a, const Cut& b)
+          {
+            return Rejection(a) > Rejection(b);
+          }
+        );
+      }
+
+      std::vector<std::pair<std::string, Double_t>> GetRejections() const
+      {
+        std::vector<std::pair<std::string, Double_t>> rejections;
+        for (const auto& c : cuts_) {
+          rejections.push_back({
+            c.name,
+            (c.n_evaluated > 0)
+              ? static_cast<Double_t>(c.n_rejected) / c.n_evaluated
+              : 0.
+          });
+        }
+        return rejections;
+      }
+    };
+  }
+}
+
+
+
+#endif // ROOTCUT_H
@@ -0,0 +1,114 @@
+#ifndef ROOTDETACH_H
+#define ROOTDETACH_H
+
+#include <mutex>
+#include <type_traits>
+
+#include "Rtypes.h"
+#include "TH1.h"
+#include "TObject.h"
+
+
+
+namespace rs
+{
+  namespace utils
+  {
+    struct DetachedState
+    {
+      /*
+        TH1::AddDirectory is a process-wide setting, so the scopes of all
+        threads share one count, and the status before the outermost scope
+        is restored when the last scope ends, in whatever order the scopes
+        of different threads end.
+      */
+
+      std::mutex mutex;
+      Int_t depth = 0;
+      Bool_t add_directory_prev = kTRUE;
+    };
+
+
+    inline DetachedState& GetDetachedState()
+    {
+      static DetachedState state;
+      return state;
+    }
+
+
+    inline Bool_t IsDetached()
+    {
+      DetachedState& state = GetDetachedState();
+      std::lock_guard<std::mutex> lock(state.mutex);
+      return state.depth > 0;
+    }
+
+
+    class DetachedScope
+    {
+      /*
+        While a DetachedScope is alive, histograms are not registered with
+        gDirectory when they are created, cloned or read
+        (TH1::AddDirectory(kFALSE)), and the histograms returned by
+        RootSupport, e.g. by file::GetObj and file::GetObjList, are removed
+        from their directory. They are then owned by their smart pointers
+        only, so that neither creating them nor closing the file walks the
+        object list of the directory.
+        The TH1::AddDirectory status before the first scope is restored
+        when the last one is destroyed; scopes may overlap across threads
+        (see DetachedState). Trees stay attached, since they need their
+        directory to be written.
+      */
+
+    public:
+      DetachedScope()
+      {
+        DetachedState& state = GetDetachedState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (state.depth++ == 0) {
+          state.add_directory_prev = TH1::AddDirectoryStatus();
+          TH1::AddDirectory(kFALSE);
+        }
+      }
+
+      ~DetachedScope()
+      {
+        DetachedState& state = GetDetachedState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (--state.depth == 0) {
+          TH1::AddDirectory(state.add_directory_prev);
+        }
+      }
+
+      DetachedScope(const DetachedScope& rh) = delete;
+
+      DetachedScope(DetachedScope&& rh) = delete;
+
+      DetachedScope& operator=(const DetachedScope& rh) = delete;
+
+      DetachedScope& operator=(DetachedScope&& rh) = delete;
+    };
+
+
+    template <typename TObjectLike>
+    void Detach(TObjectLike* obj)
+    {
+      /*
+        Removes a histogram from its directory in the detached mode.
+      */
+
+      if (!IsDetached()) {
+        return;
+      }
+      if constexpr (std::is_base_of_v<TH1, TObjectLike>) {
+        obj->SetDirectory(nullptr);
+      } else if (auto* h = dynamic_cast<TH1*>(obj)) {
+        h->SetDirectory(nullptr);
+      }
+    }
+  }
+}
+
+
+
+#endif // ROOTDETACH_H
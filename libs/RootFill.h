@@ -0,0 +1,287 @@
+#ifndef ROOTFILL_H
+#define ROOTFILL_H
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Rtypes.h"
+#include "TFile.h"
+#include "TH1.h"
+#include "TH1D.h"
+#include "TH2.h"
+#include "TH2D.h"
+#include "TROOT.h"
+#include "TTree.h"
+#include "TTreeFormula.h"
+
+#include "RootParallel.h"
+#include "RootTree.h"
+
+
+
+namespace rs
+{
+  struct HistoSpec
+  {
+    /*
+      x, y, weight and cut are branch names or TTree::Draw-like expressions.
+      y is empty for a TH1D; weight and cut are optional.
+    */
+
+    std::string name;
+    std::string title;
+    std::string x;
+    Int_t n_bins_x;
+    Double_t x_min;
+    Double_t x_max;
+    std::string y = "";
+    Int_t n_bins_y = 0;
+    Double_t y_min = 0.;
+    Double_t y_max = 0.;
+    std::string weight = "";
+    std::string cut = "";
+  };
+
+
+  class HistoFiller
+  {
+    /*
+      HistoFiller fills a set of histograms from the tree of a TreeHelper.
+      Each thread reopens the file of the tree, reads a contiguous range of
+      clusters and fills its own histogram copies, which are added up at
+      the end. Trees that are not read from a read-only file (e.g. trees
+      still being filled) are read by the calling thread.
+      With buffer_size > 0, fills are collected and binned in batches by
+      FillN.
+    */
+
+  private:
+    std::vector<HistoSpec> specs_;
+    UInt_t n_threads_;
+    std::size_t buffer_size_;
+
+
+    struct SpecFormulas
+    {
+      std::unique_ptr<TTreeFormula> x;
+      std::unique_ptr<TTreeFormula> y;
+      std::unique_ptr<TTreeFormula> weight;
+      std::unique_ptr<TTreeFormula> cut;
+      std::vector<Double_t> x_buffer;
+      std::vector<Double_t> y_buffer;
+      std::vector<Double_t> w_buffer;
+    };
+
+
+  public:
+    HistoFiller() = delete;
+
+    HistoFiller(
+      const std::vector<HistoSpec>& specs,
+      const UInt_t n_threads = 0,
+      const std::size_t buffer_size = 0
+    )
+    : specs_(specs),
+      n_threads_(utils::GetNThreads(n_threads)),
+      buffer_size_(buffer_size)
+    {
+      for (const auto& spec : specs_) {
+        if (spec.x.empty() || spec.n_bins_x <= 0) {
+          throw std::invalid_argument("Invalid x binning for " + spec.name);
+        }
+        if (!spec.y.empty() && spec.n_bins_y <= 0) {
+          throw std::invalid_argument("Invalid y binning for " + spec.name);
+        }
+      }
+    }
+
+    ~HistoFiller() = default;
+
+    HistoFiller(const HistoFiller& rh) = default;
+
+    HistoFiller(HistoFiller&& rh) = default;
+
+    HistoFiller& operator=(const HistoFiller& rh) = default;
+
+    HistoFiller& operator=(HistoFiller&& rh) = default;
+
+
+    std::vector<std::unique_ptr<TH1>> Fill(const TreeHelper& source) const
+    {
+      TTree* tree = source.GetTree();
+      const Long64_t n_entries = tree->GetEntries();
+
+      const auto clusters = utils::GetClusterRanges(tree);
+      const UInt_t n_used = (
+        (utils::IsReopenable(tree) && clusters.size() > 1)
+        ? std::min<UInt_t>(n_threads_, clusters.size())
+        : 1
+      );
+
+      // Histograms are booked here so that no thread touches gDirectory.
+      std::vector<std::vector<std::unique_ptr<TH1>>> histos(n_used);
+      for (auto& histos_thread : histos) {
+        for (const auto& spec : specs_) {
+          histos_thread.push_back(Book(spec));
+        }
+      }
+
+      if (n_used == 1) {
+        FillRange(tree, 0, n_entries, histos[0]);
+      } else {
+        ROOT::EnableThreadSafety();
+        const std::string filepath = tree->GetCurrentFile()->GetName();
+        const std::string treepath = utils::GetPathInFile(tree);
+        utils::ParallelFor(
+          0, clusters.size(),
+          [&] (const Long64_t c_begin, const Long64_t c_end, UInt_t i_thread)
+          {
+            auto [file_thread, tree_thread] = utils::ReopenTree(
+              filepath, treepath, n_entries
+            );
+            FillRange(
+              tree_thread,
+              clusters[c_begin].first,
+              clusters[c_end - 1].second,
+              histos[i_thread]
+            );
+          },
+          n_used
+        );
+      }
+
+      std::vector<std::unique_ptr<TH1>> result = std::move(histos[0]);
+      for (UInt_t i_thread = 1; i_thread < n_used; ++i_thread) {
+        for (std::size_t i = 0; i < result.size(); ++i) {
+          result[i]->Add(histos[i_thread][i].get());
+        }
+      }
+      return result;
+    }
+
+
+  private:
+    static std::unique_ptr<TH1> Book(const HistoSpec& spec)
+    {
+      std::unique_ptr<TH1> h;
+      if (spec.y.empty()) {
+        h = std::make_unique<TH1D>(
+          spec.name.c_str(), spec.title.c_str(),
+          spec.n_bins_x, spec.x_min, spec.x_max
+        );
+      } else {
+        h = std::make_unique<TH2D>(
+          spec.name.c_str(), spec.title.c_str(),
+          spec.n_bins_x, spec.x_min, spec.x_max,
+          spec.n_bins_y, spec.y_min, spec.y_max
+        );
+      }
+      h->SetDirectory(nullptr);
+      if (!spec.weight.empty()) {
+        h->Sumw2();
+      }
+      return h;
+    }
+
+
+    void FillRange(
+      TTree* tree,
+      const Long64_t first,
+      const Long64_t last,
+      const std::vector<std::unique_ptr<TH1>>& histos
+    ) const
+    {
+      auto Make_formula = [tree] (const std::string& expr)
+      {
+        std::unique_ptr<TTreeFormula> f;
+        if (!expr.empty()) {
+          f = std::make_unique<TTreeFormula>(expr.c_str(), expr.c_str(), tree);
+          if (f->GetNdim() == 0) {
+            throw std::invalid_argument("Invalid expression : " + expr);
+          }
+        }
+        return f;
+      };
+      auto Eval = [] (TTreeFormula* f)
+      {
+        f->GetNdata();
+        return f->EvalInstance(0);
+      };
+
+      std::vector<SpecFormulas> formulas(specs_.size());
+      for (std::size_t i = 0; i < specs_.size(); ++i) {
+        formulas[i].x = Make_formula(specs_[i].x);
+        formulas[i].y = Make_formula(specs_[i].y);
+        formulas[i].weight = Make_formula(specs_[i].weight);
+        formulas[i].cut = Make_formula(specs_[i].cut);
+        formulas[i].x_buffer.reserve(buffer_size_);
+        formulas[i].y_buffer.reserve(buffer_size_);
+        formulas[i].w_buffer.reserve(buffer_size_);
+      }
+
+      auto Flush = [&histos, &formulas] (const std::size_t i)
+      {
+        SpecFormulas& sf = formulas[i];
+        const Int_t n = sf.x_buffer.size();
+        if (n == 0) {
+          return;
+        }
+        if (sf.y) {
+          static_cast<TH2*>(histos[i].get())->FillN(
+            n, sf.x_buffer.data(), sf.y_buffer.data(), sf.w_buffer.data()
+          );
+        } else {
+          histos[i]->FillN(n, sf.x_buffer.data(), sf.w_buffer.data());
+        }
+        sf.x_buffer.clear();
+        sf.y_buffer.clear();
+        sf.w_buffer.clear();
+      };
+
+      tree->SetCacheSize();
+      tree->SetCacheEntryRange(first, last);
+      for (Long64_t entry = first; entry < last; ++entry) {
+        if (tree->LoadTree(entry) < 0) {
+          throw std::runtime_error(
+            "Unable to load entry " + std::to_string(entry)
+            + " of tree : " + tree->GetName()
+          );
+        }
+        for (std::size_t i = 0; i < specs_.size(); ++i) {
+          SpecFormulas& sf = formulas[i];
+          if (sf.cut && Eval(sf.cut.get()) == 0.) {
+            continue;
+          }
+          const Double_t x = Eval(sf.x.get());
+          const Double_t w = sf.weight ? Eval(sf.weight.get()) : 1.;
+          if (buffer_size_ > 0) {
+            sf.x_buffer.push_back(x);
+            sf.w_buffer.push_back(w);
+            if (sf.y) {
+              sf.y_buffer.push_back(Eval(sf.y.get()));
+            }
+            if (sf.x_buffer.size() >= buffer_size_) {
+              Flush(i);
+            }
+          } else if (sf.y) {
+            static_cast<TH2*>(histos[i].get())->Fill(
+              x, Eval(sf.y.get()), w
+            );
+          } else {
+            histos[i]->Fill(x, w);
+          }
+        }
+      }
+      for (std::size_t i = 0; i < specs_.size(); ++i) {
+        Flush(i);
+      }
+    }
+  };
+}
+
+
+
+#endif // ROOTFILL_H
@@ -0,0 +1,265 @@
+#ifndef ROOTFIT_H
+#define ROOTFIT_H
+
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Math/MinimizerOptions.h"
+#include "Rtypes.h"
+#include "TDirectory.h"
+#include "TF1.h"
+#include "TFitResultPtr.h"
+#include "TGraph.h"
+#include "TH1.h"
+#include "TROOT.h"
+
+#include "RootParallel.h"
+#include "RootTree.h"
+
+
+
+namespace rs
+{
+  struct FitRecord
+  {
+    /*
+      Outcome of one fit. message is empty on success and holds the fit
+      status or the exception text otherwise.
+    */
+
+    std::string name;
+    Int_t status = -1;
+    Double_t chi2 = 0.;
+    Int_t ndf = 0;
+    std::vector<Double_t> params;
+    std::vector<Double_t> errors;
+    std::string message;
+
+    Bool_t IsValid() const
+    {
+      return message.empty();
+    }
+  };
+
+
+  class BatchFitter
+  {
+    /*
+      BatchFitter fits one model to every TGraph or TH1 of a range.
+      The range is split into contiguous chunks, one per thread, and each
+      thread fits with its own clone of the model. With warm_start, a
+      thread starts each fit from the solution of its previous successful
+      fit, otherwise from the parameters of the model; neighbouring
+      objects (e.g. channels of one detector) usually converge faster so.
+      A failed fit is recorded in its FitRecord and the batch goes on.
+
+      TMinuit is not thread-safe, so fits run with the given minimizer
+      (Minuit2 by default), which is set as the default of
+      ROOT::Math::MinimizerOptions for the duration of Fit.
+    */
+
+  private:
+    std::unique_ptr<TF1> model_;
+    std::string opt_;
+    UInt_t n_threads_;
+    Bool_t warm_start_;
+    std::string minimizer_;
+
+
+  public:
+    BatchFitter() = delete;
+
+    BatchFitter(
+      const TF1* model,
+      Option_t* /* = const Char_t* */ opt = "",
+      const UInt_t n_threads = 0,
+      const Bool_t warm_start = kTRUE,
+      const std::string& minimizer = "Minuit2"
+    )
+    : model_(static_cast<TF1*>(model->Clone())),
+      opt_(std::string("QN") + opt),
+      n_threads_(utils::GetNThreads(n_threads)),
+      warm_start_(warm_start),
+      minimizer_(minimizer)
+    {
+    }
+
+    ~BatchFitter() = default;
+
+    BatchFitter(const BatchFitter& rh) = delete;
+
+    BatchFitter(BatchFitter&& rh) = default;
+
+    BatchFitter& operator=(const BatchFitter& rh) = delete;
+
+    BatchFitter& operator=(BatchFitter&& rh) = default;
+
+
+    template <typename TObjectRange>
+    std::vector<FitRecord> Fit(const TObjectRange& objs) const
+    {
+      /*
+        objs is a range of (smart) pointers to TGraph or TH1; the records
+        are in the same order.
+      */
+
+      using TObjectLike = std::remove_pointer_t<
+        decltype(&**std::begin(objs))
+      >;
+      static_assert(
+        (
+          std::is_base_of_v<TGraph, TObjectLike>
+          || std::is_base_of_v<TH1, TObjectLike>
+        ),
+        "Elements of TObjectRange must point to TGraph or TH1."
+      );
+
+      std::vector<TObjectLike*> targets;
+      for (const auto& obj : objs) {
+        targets.push_back(&*obj);
+      }
+      std::vector<FitRecord> records(targets.size());
+      if (targets.empty()) {
+        return records;
+      }
+
+      // Clones are made here, since TF1 copies go through the interpreter.
+      const UInt_t n_used = std::min<std::size_t>(n_threads_, targets.size());
+      std::vector<std::unique_ptr<TF1>> models;
+      for (UInt_t i = 0; i < n_used; ++i) {
+        models.emplace_back(static_cast<TF1*>(model_->Clone()));
+      }
+
+      const std::string minimizer_prev = (
+        ROOT::Math::MinimizerOptions::DefaultMinimizerType()
+      );
+      ROOT::Math::MinimizerOptions::SetDefaultMinimizer(minimizer_.c_str());
+      if (n_used > 1) {
+        ROOT::EnableThreadSafety();
+      }
+      try {
+        utils::ParallelFor(
+          0, targets.size(),
+          [&] (const Long64_t begin, const Long64_t end, UInt_t i_thread)
+          {
+            FitRange(
+              targets.data() + begin, records.data() + begin,
+              end - begin, models[i_thread].get()
+            );
+          },
+          n_used
+        );
+      } catch (...) {
+        ROOT::Math::MinimizerOptions::SetDefaultMinimizer(
+          minimizer_prev.c_str()
+        );
+        throw;
+      }
+      ROOT::Math::MinimizerOptions::SetDefaultMinimizer(minimizer_prev.c_str());
+      return records;
+    }
+
+
+    TreeHelper MakeTree(
+      const std::vector<FitRecord>& records, TDirectory* dir = nullptr
+    ) const
+    {
+      /*
+        One entry per record, in dir (gDirectory by default), with the
+        branches index/I, status/I, is_valid/B, chi2/D, ndf/I and, for each
+        parameter i of the model, p<i>/D and p<i>_err/D. index is the
+        position of the object in the fitted range.
+      */
+
+      const Int_t n_par = model_->GetNpar();
+      std::vector<std::string> branch_names = {
+        "index/I", "status/I", "is_valid/B", "chi2/D", "ndf/I"
+      };
+      for (Int_t i = 0; i < n_par; ++i) {
+        branch_names.push_back("p" + std::to_string(i) + "/D");
+        branch_names.push_back("p" + std::to_string(i) + "_err/D");
+      }
+
+      std::unique_ptr<TDirectory::TContext> context;
+      if (dir) {
+        context = std::make_unique<TDirectory::TContext>(dir);
+      }
+      TreeHelper helper(branch_names);
+
+      auto& index = std::get<Int_t>(helper.get("index/I"));
+      auto& status = std::get<Int_t>(helper.get("status/I"));
+      auto& is_valid = std::get<Bool_t>(helper.get("is_valid/B"));
+      auto& chi2 = std::get<Double_t>(helper.get("chi2/D"));
+      auto& ndf = std::get<Int_t>(helper.get("ndf/I"));
+      std::vector<Double_t*> params(n_par);
+      std::vector<Double_t*> errors(n_par);
+      for (Int_t i = 0; i < n_par; ++i) {
+        const std::string p = "p" + std::to_string(i);
+        params[i] = &std::get<Double_t>(helper.get(p + "/D"));
+        errors[i] = &std::get<Double_t>(helper.get(p + "_err/D"));
+      }
+
+      for (std::size_t i_record = 0; i_record < records.size(); ++i_record) {
+        const FitRecord& record = records[i_record];
+        index = i_record;
+        status = record.status;
+        is_valid = record.IsValid();
+        chi2 = record.chi2;
+        ndf = record.ndf;
+        for (Int_t i = 0; i < n_par; ++i) {
+          const Bool_t has_value = i < static_cast<Int_t>(record.params.size());
+          *params[i] = has_value ? record.params[i] : 0.;
+          *errors[i] = has_value ? record.errors[i] : 0.;
+        }
+        helper.Fill();
+      }
+      return helper;
+    }
+
+
+  private:
+    template <typename TObjectLike>
+    void FitRange(
+      TObjectLike* const* targets,
+      FitRecord* records,
+      const Long64_t n,
+      TF1* f
+    ) const
+    {
+      const Int_t n_par = f->GetNpar();
+      const std::vector<Double_t> initial(
+        model_->GetParameters(), model_->GetParameters() + n_par
+      );
+
+      for (Long64_t i = 0; i < n; ++i) {
+        FitRecord& record = records[i];
+        record.name = targets[i]->GetName();
+        if (!warm_start_ || i == 0 || !records[i - 1].IsValid()) {
+          f->SetParameters(initial.data());
+        }
+
+        try {
+          record.status = targets[i]->Fit(f, opt_.c_str());
+        } catch (const std::exception& e) {
+          record.message = e.what();
+          continue;
+        }
+        if (record.status != 0) {
+          record.message = "fit status " + std::to_string(record.status);
+        }
+        record.chi2 = f->GetChisquare();
+        record.ndf = f->GetNDF();
+        record.params.assign(f->GetParameters(), f->GetParameters() + n_par);
+        record.errors.assign(f->GetParErrors(), f->GetParErrors() + n_par);
+      }
+    }
+  };
+}
+
+
+
+#endif // ROOTFIT_H
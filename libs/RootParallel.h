@@ -0,0 +1,84 @@
+#ifndef ROOTPARALLEL_H
+#define ROOTPARALLEL_H
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+#include "Rtypes.h"
+
+
+
+namespace rs
+{
+  namespace utils
+  {
+    inline UInt_t GetNThreads(const UInt_t n_threads = 0)
+    {
+      if (n_threads > 0) {
+        return n_threads;
+      }
+      return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+
+    template <typename Function>
+    void ParallelFor(
+      const Long64_t begin,
+      const Long64_t end,
+      Function&& func,
+      const UInt_t n_threads = 0
+    )
+    {
+      /*
+        Splits [begin, end) into contiguous chunks, one per thread, and calls
+        func(chunk_begin, chunk_end, i_thread) on each. The first exception
+        thrown by any chunk is rethrown after all threads have joined.
+      */
+
+      if (end <= begin) {
+        return;
+      }
+
+      const Long64_t n = end - begin;
+      const UInt_t n_used = static_cast<UInt_t>(
+        std::min<Long64_t>(GetNThreads(n_threads), n)
+      );
+      if (n_used == 1) {
+        func(begin, end, 0u);
+        return;
+      }
+
+      std::vector<std::exception_ptr> errors(n_used);
+      std::vector<std::thread> threads;
+      threads.reserve(n_used);
+      for (UInt_t i_thread = 0; i_thread < n_used; ++i_thread) {
+        const Long64_t chunk_begin = begin + n * i_thread / n_used;
+        const Long64_t chunk_end = begin + n * (i_thread + 1) / n_used;
+        threads.emplace_back(
+          [&func, &errors, chunk_begin, chunk_end, i_thread] ()
+          {
+            try {
+              func(chunk_begin, chunk_end, i_thread);
+            } catch (...) {
+              errors[i_thread] = std::current_exception();
+            }
+          }
+        );
+      }
+      for (auto& t : threads) {
+        t.join();
+      }
+      for (const auto& e : errors) {
+        if (e) {
+          std::rethrow_exception(e);
+        }
+      }
+    }
+  }
+}
+
+
+
+#endif // ROOTPARALLEL_H
@@ -6,10 +6,13 @@
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
 #include "Rtypes.h"
+#include "TDirectory.h"
+#include "TFile.h"
 #include "TLeaf.h"
 #include "TObjArray.h"
 #include "TTree.h"
@@ -132,6 +135,11 @@ namespace rs
       return vals_.at(bname);
     }
 
+    TTree* GetTree() const
+    {
+      return tree_.get();
+    }
+
     Long64_t GetEntries() const
     {
       return tree_->GetEntries();
@@ -152,6 +160,87 @@ namespace rs
       return tree_->Write();
     }
   };
+
+
+  namespace utils
+  {
+    inline std::vector<std::pair<Long64_t, Long64_t>> GetClusterRanges(
+      TTree* tree
+    )
+    {
+      /*
+        [first, last) entry ranges of the clusters of the tree.
+      */
+
+      const Long64_t n_entries = tree->GetEntries();
+      std::vector<std::pair<Long64_t, Long64_t>> clusters;
+      auto cluster_iter = tree->GetClusterIterator(0);
+      while (true) {
+        const Long64_t start = cluster_iter.Next();
+        if (start >= n_entries) {
+          break;
+        }
+        clusters.push_back({start, cluster_iter.GetNextEntry()});
+      }
+      return clusters;
+    }
+
+
+    inline std::string GetPathInFile(const TTree* tree)
+    {
+      std::string path = tree->GetDirectory()->GetPath();
+      const std::size_t pos = path.find(":/");
+      path = (pos == std::string::npos) ? "" : path.substr(pos + 2);
+      if (!path.empty()) {
+        path += "/";
+      }
+      return path + tree->GetName();
+    }
+
+
+    inline Bool_t IsReopenable(TTree* tree)
+    {
+      /*
+        Whether ReopenTree sees the same entries as tree, i.e. whether the
+        tree is read from a file opened read-only. A tree in a writable file
+        may hold entries that are not written yet, and its file may hold
+        only an older autosaved cycle of it.
+      */
+
+      const TFile* file = tree->GetCurrentFile();
+      return file && !file->IsWritable();
+    }
+
+
+    inline std::pair<std::unique_ptr<TFile>, TTree*> ReopenTree(
+      const std::string& filepath,
+      const std::string& treepath,
+      const Long64_t n_entries = -1
+    )
+    {
+      /*
+        Opens a private handle on the tree, e.g. for one thread.
+        The tree is owned by the returned file. With n_entries >= 0, the
+        reopened tree must have that many entries.
+      */
+
+      std::unique_ptr<TFile> file(TFile::Open(filepath.c_str(), "READ"));
+      if (!file || file->IsZombie()) {
+        throw std::runtime_error("failed to open this file : " + filepath);
+      }
+      TTree* tree = nullptr;
+      file->GetObject(treepath.c_str(), tree);
+      if (!tree) {
+        throw std::runtime_error("No such tree : " + treepath);
+      }
+      if (n_entries >= 0 && tree->GetEntries() != n_entries) {
+        throw std::runtime_error(
+          "Tree differs from the one in memory : " + treepath
+        );
+      }
+      return {std::move(file), tree};
+    }
+  }
 }
 
 
@@ -0,0 +1,343 @@
+#ifndef ROOTTREEINDEX_H
+#define ROOTTREEINDEX_H
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Rtypes.h"
+#include "TBranch.h"
+#include "TDirectory.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TUUID.h"
+
+#include "RootTree.h"
+
+
+
+namespace rs
+{
+  class TreeIndex
+  {
+    /*
+      TreeIndex is a sorted (key, entry) table over one or two Int_t
+      branches of a TreeHelper, e.g. (run, event). The two values are packed
+      into one 64-bit key, so lookups are a binary search.
+      The index is persisted next to the tree as a std::vector<Long64_t>
+      named "<tree>_index_<major>[_<minor>]", holding the number of entries
+      of the tree and a fingerprint (MakeFingerprint) followed by the
+      (key, entry) pairs. The constructor loads it when both match the
+      tree and scans the key branches otherwise.
+    */
+
+  private:
+    std::string major_;
+    std::string minor_;
+    std::vector<std::pair<Long64_t, Long64_t>> table_;
+
+
+  public:
+    TreeIndex() = delete;
+
+    TreeIndex(
+      TreeHelper& helper,
+      const std::string& major,
+      const std::string& minor = ""
+    )
+    : major_(major), minor_(minor)
+    {
+      if (!Load(helper)) {
+        Build(helper);
+      }
+    }
+
+    ~TreeIndex() = default;
+
+    TreeIndex(const TreeIndex& rh) = default;
+
+    TreeIndex(TreeIndex&& rh) = default;
+
+    TreeIndex& operator=(const TreeIndex& rh) = default;
+
+    TreeIndex& operator=(TreeIndex&& rh) = default;
+
+
+    static Long64_t MakeKey(const Int_t major, const Int_t minor = 0)
+    {
+      // Keeps the (major, minor) order and fits in 64 bits.
+      return (
+        static_cast<Long64_t>(major) * (Long64_t(1) << 32)
+        + (static_cast<Long64_t>(minor) - std::numeric_limits<Int_t>::min())
+      );
+    }
+
+    std::string GetObjectName(const TreeHelper& helper) const
+    {
+      std::string name = std::string(helper.GetTree()->GetName()) + "_index_";
+      name += major_;
+      if (!minor_.empty()) {
+        name += "_" + minor_;
+      }
+      return name;
+    }
+
+    Long64_t GetSize() const
+    {
+      return table_.size();
+    }
+
+    const std::vector<std::pair<Long64_t, Long64_t>>& GetTable() const
+    {
+      return table_;
+    }
+
+    Long64_t Find(const Int_t major, const Int_t minor = 0) const
+    {
+      /*
+        Returns the first entry with this key, or -1.
+      */
+
+      const Long64_t key = MakeKey(major, minor);
+      auto iter = std::lower_bound(
+        table_.begin(), table_.end(), std::make_pair(key, Long64_t(-1))
+      );
+      if (iter == table_.end() || iter->first != key) {
+        return -1;
+      }
+      return iter->second;
+    }
+
+    Int_t GetEntryWithIndex(
+      TreeHelper& helper, const Int_t major, const Int_t minor = 0
+    ) const
+    {
+      const Long64_t entry = Find(major, minor);
+      if (entry < 0) {
+        return -1;
+      }
+      return helper.GetEntry(entry);
+    }
+
+    Long64_t MakeFingerprint(const TreeHelper& helper) const
+    {
+      /*
+        FNV-1a hash of the key branch names, the UUID of the file and the
+        sizes and basket positions of the key branches. A tree rewritten
+        with the same number of entries has its baskets elsewhere in the
+        file, or is in a file with another UUID. Baskets that are not
+        written yet are not covered, see Save.
+      */
+
+      ULong64_t hash = 14695981039346656037ULL;
+      auto Add_bytes = [&hash] (const void* data, const std::size_t size)
+      {
+        const UChar_t* bytes = static_cast<const UChar_t*>(data);
+        for (std::size_t i = 0; i < size; ++i) {
+          hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+      };
+      auto Add_value = [&Add_bytes] (const Long64_t value)
+      {
+        Add_bytes(&value, sizeof(value));
+      };
+      auto Add_string = [&Add_bytes] (const std::string& str)
+      {
+        Add_bytes(str.c_str(), str.size() + 1);
+      };
+
+      TTree* tree = helper.GetTree();
+      Add_string(major_);
+      Add_string(minor_);
+      if (const TFile* file = tree->GetCurrentFile()) {
+        Add_string(file->GetUUID().AsString());
+      }
+      for (const std::string& bname : {major_, minor_}) {
+        const TBranch* branch = (
+          bname.empty() ? nullptr : tree->GetBranch(bname.c_str())
+        );
+        if (!branch) {
+          continue;
+        }
+        Add_value(branch->GetTotBytes());
+        Add_value(branch->GetZipBytes());
+        for (Int_t i = 0; i < branch->GetWriteBasket(); ++i) {
+          Add_value(branch->GetBasketSeek(i));
+        }
+      }
+      return static_cast<Long64_t>(hash);
+    }
+
+    Int_t Save(const TreeHelper& helper) const
+    {
+      /*
+        The baskets of the tree are flushed first, so that the fingerprint
+        covers every entry.
+      */
+
+      TDirectory* dir = helper.GetTree()->GetDirectory();
+      if (!dir) {
+        throw std::runtime_error(
+          std::string("Tree is not attached to a directory : ")
+          + helper.GetTree()->GetName()
+        );
+      }
+      helper.GetTree()->FlushBaskets();
+
+      std::vector<Long64_t> data;
+      data.reserve(2 * table_.size() + 2);
+      data.push_back(helper.GetEntries());
+      data.push_back(MakeFingerprint(helper));
+      for (const auto& [key, entry] : table_) {
+        data.push_back(key);
+        data.push_back(entry);
+      }
+      return dir->WriteObject(
+        &data, GetObjectName(helper).c_str(), "WriteDelete"
+      );
+    }
+
+
+  private:
+    Bool_t Load(const TreeHelper& helper)
+    {
+      TDirectory* dir = helper.GetTree()->GetDirectory();
+      if (!dir) {
+        return kFALSE;
+      }
+
+      std::vector<Long64_t>* data_raw = nullptr;
+      dir->GetObject(GetObjectName(helper).c_str(), data_raw);
+      std::unique_ptr<std::vector<Long64_t>> data(data_raw);
+      if (
+        !data
+        || data->size() < 2
+        || data->size() % 2 != 0
+        || (*data)[0] != helper.GetEntries()
+        || (*data)[1] != MakeFingerprint(helper)
+      ) {
+        return kFALSE;
+      }
+
+      const std::size_t n = (data->size() - 2) / 2;
+      table_.resize(n);
+      for (std::size_t i = 0; i < n; ++i) {
+        table_[i] = {(*data)[2 * i + 2], (*data)[2 * i + 3]};
+      }
+      return kTRUE;
+    }
+
+    void Build(TreeHelper& helper)
+    {
+      auto Find_value = [&helper] (const std::string& bname)
+      {
+        const Int_t* ptr = nullptr;
+        try {
+          ptr = std::get_if<Int_t>(&helper.get(bname + "/I"));
+        } catch (const std::out_of_range&) {
+          throw std::invalid_argument("No such Int_t branch : " + bname);
+        }
+        return ptr;
+      };
+
+      TTree* tree = helper.GetTree();
+      const Int_t* major = Find_value(major_);
+      const Int_t* minor = minor_.empty() ? nullptr : Find_value(minor_);
+      TBranch* major_branch = tree->GetBranch(major_.c_str());
+      TBranch* minor_branch = (
+        minor_.empty() ? nullptr : tree->GetBranch(minor_.c_str())
+      );
+
+      // Only the key branches are read.
+      const Long64_t n_entries = helper.GetEntries();
+      table_.resize(n_entries);
+      for (Long64_t entry = 0; entry < n_entries; ++entry) {
+        major_branch->GetEntry(entry);
+        if (minor_branch) {
+          minor_branch->GetEntry(entry);
+        }
+        table_[entry] = {MakeKey(*major, minor ? *minor : 0), entry};
+      }
+      std::sort(table_.begin(), table_.end());
+    }
+  };
+
+
+  inline std::vector<std::pair<Long64_t, Long64_t>> MatchEntries(
+    const TreeIndex& left, const TreeIndex& right
+  )
+  {
+    /*
+      Merge join of two indexes: every (left_entry, right_entry) pair with
+      equal keys, sorted by left entry (then right entry) so that the left
+      tree is read sequentially.
+    */
+
+    const auto& l = left.GetTable();
+    const auto& r = right.GetTable();
+    std::vector<std::pair<Long64_t, Long64_t>> matches;
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < l.size() && j < r.size()) {
+      if (l[i].first < r[j].first) {
+        ++i;
+      } else if (r[j].first < l[i].first) {
+        ++j;
+      } else {
+        const Long64_t key = l[i].first;
+        std::size_t i_end = i;
+        std::size_t j_end = j;
+        while (i_end < l.size() && l[i_end].first == key) {
+          ++i_end;
+        }
+        while (j_end < r.size() && r[j_end].first == key) {
+          ++j_end;
+        }
+        for (std::size_t ii = i; ii < i_end; ++ii) {
+          for (std::size_t jj = j; jj < j_end; ++jj) {
+            matches.push_back({l[ii].second, r[jj].second});
+          }
+        }
+        i = i_end;
+        j = j_end;
+      }
+    }
+    std::sort(matches.begin(), matches.end());
+    return matches;
+  }
+
+
+  template <typename Function>
+  void Join(
+    TreeHelper& left,
+    const TreeIndex& left_index,
+    TreeHelper& right,
+    const TreeIndex& right_index,
+    Function&& func
+  )
+  {
+    /*
+      Loads each matching pair of entries into the two helpers and calls
+      func(left_entry, right_entry).
+    */
+
+    Long64_t left_loaded = -1;
+    for (const auto& [l, r] : MatchEntries(left_index, right_index)) {
+      if (l != left_loaded) {
+        left.GetEntry(l);
+        left_loaded = l;
+      }
+      right.GetEntry(r);
+      func(l, r);
+    }
+  }
+}
+
+
+
+#endif // ROOTTREEINDEX_H
@@ -0,0 +1,319 @@
+#ifndef ROOTTREEPROFILE_H
+#define ROOTTREEPROFILE_H
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Rtypes.h"
+#include "TBranch.h"
+#include "TDirectory.h"
+#include "TFile.h"
+#include "TObjArray.h"
+#include "TTree.h"
+
+#include "RootTree.h"
+
+
+
+namespace rs
+{
+  class TreeProfiler
+  {
+    /*
+      TreeProfiler is an opt-in replacement for TreeHelper::GetEntry that
+      reads the branches one by one and records, per branch, the calls,
+      the uncompressed bytes returned, the wall time, and the baskets
+      loaded with the time of those calls (I/O plus decompression, which
+      ROOT does not expose per branch). The on-disk compressed and
+      uncompressed sizes of each branch, the bytes and read calls of the
+      file, and the time spent in the user's loop body (see TimeBody) are
+      recorded as well. Results are printed as a table or written as a
+      TTree or a JSON file.
+    */
+
+  public:
+    struct BranchProfile
+    {
+      std::string name;
+      Long64_t n_calls = 0;
+      Long64_t bytes_read = 0;
+      Long64_t n_baskets = 0;
+      Double_t read_time = 0.;
+      Double_t basket_time = 0.;
+      Long64_t zip_bytes = 0;
+      Long64_t tot_bytes = 0;
+    };
+
+
+    class BodyTimer
+    {
+    private:
+      TreeProfiler* profiler_;
+      std::chrono::steady_clock::time_point start_;
+
+
+    public:
+      BodyTimer(TreeProfiler* profiler)
+      : profiler_(profiler), start_(std::chrono::steady_clock::now())
+      {
+      }
+
+      ~BodyTimer()
+      {
+        profiler_->body_time_ += Seconds(start_);
+      }
+
+      BodyTimer(const BodyTimer& rh) = delete;
+
+      BodyTimer& operator=(const BodyTimer& rh) = delete;
+    };
+
+
+  private:
+    TreeHelper& helper_;
+    std::vector<TBranch*> branches_;
+    std::vector<BranchProfile> profiles_;
+    Long64_t n_entries_ = 0;
+    Double_t body_time_ = 0.;
+    Long64_t file_bytes_start_ = 0;
+    Int_t file_calls_start_ = 0;
+
+
+  public:
+    TreeProfiler() = delete;
+
+    TreeProfiler(TreeHelper& helper)
+    : helper_(helper)
+    {
+      TObjArray* branches = helper_.GetTree()->GetListOfBranches();
+      for (Int_t i = 0; i < branches->GetEntries(); ++i) {
+        auto* branch = static_cast<TBranch*>(branches->At(i));
+        branches_.push_back(branch);
+        BranchProfile profile;
+        profile.name = branch->GetName();
+        profile.zip_bytes = branch->GetZipBytes("*");
+        profile.tot_bytes = branch->GetTotBytes("*");
+        profiles_.push_back(profile);
+      }
+      if (TFile* file = helper_.GetTree()->GetCurrentFile()) {
+        file_bytes_start_ = file->GetBytesRead();
+        file_calls_start_ = file->GetReadCalls();
+      }
+    }
+
+    ~TreeProfiler() = default;
+
+    TreeProfiler(const TreeProfiler& rh) = delete;
+
+    TreeProfiler(TreeProfiler&& rh) = default;
+
+    TreeProfiler& operator=(const TreeProfiler& rh) = delete;
+
+    TreeProfiler& operator=(TreeProfiler&& rh) = delete;
+
+
+    Int_t GetEntry(const Long64_t entry)
+    {
+      if (helper_.GetTree()->LoadTree(entry) < 0) {
+        return 0;
+      }
+
+      Int_t n_bytes = 0;
+      for (std::size_t i = 0; i < branches_.size(); ++i) {
+        TBranch* branch = branches_[i];
+        BranchProfile& profile = profiles_[i];
+
+        const Int_t basket_before = branch->GetReadBasket();
+        const auto start = std::chrono::steady_clock::now();
+        const Int_t n_bytes_branch = branch->GetEntry(entry);
+        const Double_t time = Seconds(start);
+
+        ++profile.n_calls;
+        profile.bytes_read += n_bytes_branch;
+        profile.read_time += time;
+        if (branch->GetReadBasket() != basket_before || profile.n_calls == 1) {
+          ++profile.n_baskets;
+          profile.basket_time += time;
+        }
+        n_bytes += n_bytes_branch;
+      }
+      ++n_entries_;
+      return n_bytes;
+    }
+
+    BodyTimer TimeBody()
+    {
+      return BodyTimer(this);
+    }
+
+    const std::vector<BranchProfile>& GetBranchProfiles() const
+    {
+      return profiles_;
+    }
+
+    Double_t GetBodyTime() const
+    {
+      return body_time_;
+    }
+
+    Long64_t GetFileBytesRead() const
+    {
+      TFile* file = helper_.GetTree()->GetCurrentFile();
+      return file ? file->GetBytesRead() - file_bytes_start_ : 0;
+    }
+
+    Int_t GetFileReadCalls() const
+    {
+      // Read calls issued to the file, which is neither the number of
+      // baskets read nor the number of TTreeCache misses.
+      TFile* file = helper_.GetTree()->GetCurrentFile();
+      return file ? file->GetReadCalls() - file_calls_start_ : 0;
+    }
+
+    void Print(std::ostream& os = std::cout) const
+    {
+      os
+        << std::left << std::setw(24) << "branch"
+        << std::right
+        << std::setw(12) << "calls"
+        << std::setw(14) << "bytes"
+        << std::setw(10) << "baskets"
+        << std::setw(12) << "read [s]"
+        << std::setw(12) << "basket [s]"
+        << std::setw(14) << "zip bytes"
+        << std::setw(14) << "tot bytes"
+        << std::setw(8) << "ratio"
+        << std::endl;
+      for (const auto& p : profiles_) {
+        os
+          << std::left << std::setw(24) << p.name
+          << std::right
+          << std::setw(12) << p.n_calls
+          << std::setw(14) << p.bytes_read
+          << std::setw(10) << p.n_baskets
+          << std::setw(12) << std::setprecision(4) << p.read_time
+          << std::setw(12) << std::setprecision(4) << p.basket_time
+          << std::setw(14) << p.zip_bytes
+          << std::setw(14) << p.tot_bytes
+          << std::setw(8) << std::setprecision(3) << GetRatio(p)
+          << std::endl;
+      }
+      os
+        << "entries : " << n_entries_
+        << ", body [s] : " << body_time_
+        << ", file bytes read : " << GetFileBytesRead()
+        << ", file read calls : " << GetFileReadCalls()
+        << std::endl;
+    }
+
+    Int_t Write(TDirectory* dir, const Char_t* name = "tree_profile") const
+    {
+      /*
+        One entry per branch.
+      */
+
+      BranchProfile p;
+      Char_t branch_name[256];
+      Double_t ratio;
+
+      TDirectory::TContext context(dir);
+      TTree tree(name, "per-branch I/O profile");
+      tree.Branch("branch", branch_name, "branch/C");
+      tree.Branch("n_calls", &p.n_calls, "n_calls/L");
+      tree.Branch("bytes_read", &p.bytes_read, "bytes_read/L");
+      tree.Branch("n_baskets", &p.n_baskets, "n_baskets/L");
+      tree.Branch("read_time", &p.read_time, "read_time/D");
+      tree.Branch("basket_time", &p.basket_time, "basket_time/D");
+      tree.Branch("zip_bytes", &p.zip_bytes, "zip_bytes/L");
+      tree.Branch("tot_bytes", &p.tot_bytes, "tot_bytes/L");
+      tree.Branch("ratio", &ratio, "ratio/D");
+      for (const auto& profile : profiles_) {
+        p = profile;
+        p.name.copy(branch_name, sizeof(branch_name) - 1);
+        branch_name[std::min(p.name.size(), sizeof(branch_name) - 1)] = '\0';
+        ratio = GetRatio(p);
+        tree.Fill();
+      }
+      return tree.Write();
+    }
+
+    void WriteJson(const std::string& filepath) const
+    {
+      std::ofstream ofs(filepath);
+      if (!ofs) {
+        throw std::runtime_error("failed to open this file : " + filepath);
+      }
+
+      ofs << std::setprecision(9);
+      ofs << "{\n";
+      ofs << "  \"entries\": " << n_entries_ << ",\n";
+      ofs << "  \"body_time\": " << body_time_ << ",\n";
+      ofs << "  \"file_bytes_read\": " << GetFileBytesRead() << ",\n";
+      ofs << "  \"file_read_calls\": " << GetFileReadCalls() << ",\n";
+      ofs << "  \"branches\": [\n";
+      for (std::size_t i = 0; i < profiles_.size(); ++i) {
+        const auto& p = profiles_[i];
+        ofs
+          << "    {\"branch\": \"" << EscapeJson(p.name) << "\""
+          << ", \"n_calls\": " << p.n_calls
+          << ", \"bytes_read\": " << p.bytes_read
+          << ", \"n_baskets\": " << p.n_baskets
+          << ", \"read_time\": " << p.read_time
+          << ", \"basket_time\": " << p.basket_time
+          << ", \"zip_bytes\": " << p.zip_bytes
+          << ", \"tot_bytes\": " << p.tot_bytes
+          << ", \"ratio\": " << GetRatio(p)
+          << "}" << ((i + 1 < profiles_.size()) ? "," : "") << "\n";
+      }
+      ofs << "  ]\n";
+      ofs << "}\n";
+    }
+
+
+  private:
+    static Double_t Seconds(const std::chrono::steady_clock::time_point start)
+    {
+      return std::chrono::duration<Double_t>(
+        std::chrono::steady_clock::now() - start
+      ).count();
+    }
+
+    static std::string EscapeJson(const std::string& str)
+    {
+      std::string escaped;
+      escaped.reserve(str.size());
+      for (const Char_t c : str) {
+        if (c == '"' || c == '\\') {
+          escaped += '\\';
+          escaped += c;
+        } else if (static_cast<UChar_t>(c) < 0x20) {
+          static constexpr Char_t hex[] = "0123456789abcdef";
+          escaped += "\\u00";
+          escaped += hex[(c >> 4) & 0xf];
+          escaped += hex[c & 0xf];
+        } else {
+          escaped += c;
+        }
+      }
+      return escaped;
+    }
+
+    static Double_t GetRatio(const BranchProfile& p)
+    {
+      return (p.zip_bytes > 0)
+        ? static_cast<Double_t>(p.tot_bytes) / p.zip_bytes
+        : 0.;
+    }
+  };
+}
+
+
+
+#endif // ROOTTREEPROFILE_H